@@ -0,0 +1,636 @@
+#pragma once
+
+#include "graph.h"
+#include "parallel.h"
+#include "serialization.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Иерархия сжатия (Contraction Hierarchies). Вершины по очереди исключаются из графа в порядке
+// «важности»; чтобы не потерять кратчайшие пути, вместо исключённой вершины добавляются
+// рёбра-сокращения. Запрос — двунаправленный поиск, идущий только вверх по этому порядку.
+// Сокращения раскрываются обратно в последовательность исходных рёбер графа.
+template <typename Weight>
+class ContractionHierarchy {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    struct Path {
+        Weight weight;
+        std::vector<EdgeId> edges;
+        size_t settled_vertices = 0;
+    };
+
+    explicit ContractionHierarchy(const Graph& graph);
+    // Загружает иерархию, сохранённую Save для того же graph; испорченные данные — FormatError
+    ContractionHierarchy(serialization::Reader& reader, const Graph& graph);
+
+    void Save(serialization::Writer& writer) const;
+
+    std::optional<Path> FindPath(VertexId from, VertexId to) const;
+    // Веса путей из каждой вершины sources в каждую вершину targets, построчно: ячейка
+    // i * targets.size() + j — путь sources[i] -> targets[j]. Обратный поиск из каждой цели
+    // раскладывает по достигнутым вершинам «корзины» с весом до цели, прямой поиск
+    // из источника просматривает корзины своих вершин. Поиски идут только вверх по порядку.
+    std::vector<std::optional<Weight>> FindWeightMatrix(const std::vector<VertexId>& sources,
+                                                        const std::vector<VertexId>& targets) const;
+
+    size_t GetShortcutCount() const {
+        return arcs_.size() - original_edge_count_;
+    }
+
+private:
+    static constexpr EdgeId NO_ARC = std::numeric_limits<EdgeId>::max();
+    // Поиск свидетеля прекращается после стольких извлечённых вершин; если свидетель
+    // не найден, сокращение добавляется (это безопасно, просто даёт лишние рёбра)
+    static constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+    // При оценке приоритета точность не нужна: хватает короткого поиска
+    static constexpr size_t ESTIMATE_SETTLE_LIMIT = 50;
+
+    // Дуга иерархии: исходное ребро (first == NO_ARC, номер дуги равен EdgeId)
+    // или сокращение, составленное из дуг first и second
+    struct Arc {
+        VertexId from;
+        VertexId to;
+        Weight weight;
+        EdgeId first = NO_ARC;
+        EdgeId second = NO_ARC;
+    };
+
+    // Состояние, нужное только на этапе предподсчёта
+    struct ContractionState {
+        std::vector<std::vector<EdgeId>> out_arcs;
+        std::vector<std::vector<EdgeId>> in_arcs;
+        std::vector<bool> contracted;
+        std::vector<std::optional<Weight>> witness_weights;
+        std::vector<VertexId> witness_touched;
+        // Концы исходящих дуг сжимаемой вершины: поиск свидетеля останавливается,
+        // когда все они извлечены
+        std::vector<bool> is_target;
+        size_t target_count = 0;
+    };
+
+    void AddArc(ContractionState& state, const Arc& arc);
+    void WitnessSearch(ContractionState& state, VertexId source, VertexId skipped,
+                       Weight max_weight, size_t settle_limit) const;
+    // Считает (dry_run, с коротким поиском свидетелей) или добавляет сокращения,
+    // нужные для исключения вершины
+    size_t ContractVertex(ContractionState& state, VertexId vertex, bool dry_run);
+    int ComputePriority(ContractionState& state, VertexId vertex,
+                        const std::vector<int>& contracted_neighbours);
+    void BuildSearchGraphs();
+    // Проверяет загруженные данные: все номера в пределах массивов, сокращения ссылаются
+    // на более ранние дуги, дуги поиска идут вверх по порядку — иначе FormatError
+    void CheckLoadedData() const;
+    void UnpackArc(EdgeId arc_id, std::vector<EdgeId>& edges) const;
+    // Полный поиск вверх из start (по обратным дугам, если is_backward): callback(vertex, weight)
+    // для каждой извлечённой вершины
+    template <typename Callback>
+    void ForEachUpwardVertex(VertexId start, bool is_backward, Callback&& callback) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    size_t vertex_count_ = 0;
+    size_t original_edge_count_ = 0;
+    std::vector<Arc> arcs_;
+    std::vector<size_t> rank_;
+
+    // Дуги, ведущие вверх по порядку: прямые — из вершины, обратные — в вершину
+    std::vector<size_t> upward_offsets_;
+    std::vector<EdgeId> upward_arcs_;
+    std::vector<size_t> downward_offsets_;
+    std::vector<EdgeId> downward_arcs_;
+};
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(const Graph& graph)
+    : vertex_count_(graph.GetVertexCount())
+    , original_edge_count_(graph.GetEdgeCount())
+    , rank_(graph.GetVertexCount())
+{
+    ContractionState state;
+    state.out_arcs.resize(vertex_count_);
+    state.in_arcs.resize(vertex_count_);
+    state.contracted.assign(vertex_count_, false);
+    state.witness_weights.resize(vertex_count_);
+    state.is_target.assign(vertex_count_, false);
+
+    arcs_.reserve(original_edge_count_);
+    for (EdgeId edge_id = 0; edge_id < original_edge_count_; ++edge_id) {
+        const auto& edge = graph.GetEdge(edge_id);
+        // Номера дуг совпадают с номерами рёбер, поэтому удалённое ребро остаётся петлёй:
+        // петли не участвуют ни в сжатии, ни в поиске
+        const VertexId to = graph.IsEdgeRemoved(edge_id) ? edge.from : edge.to;
+        arcs_.push_back(Arc{edge.from, to, edge.weight});
+        AddArc(state, arcs_.back());
+    }
+
+    std::vector<int> contracted_neighbours(vertex_count_, 0);
+    // Сжатие вершины меняет приоритет только её соседей: их оценка помечается устаревшей
+    // и пересчитывается при извлечении, остальные вершины сжимаются без пересчёта
+    std::vector<bool> is_stale(vertex_count_, false);
+    using QueueItem = std::pair<int, VertexId>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        queue.push({ComputePriority(state, vertex, contracted_neighbours), vertex});
+    }
+
+    size_t next_rank = 0;
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().second;
+        queue.pop();
+
+        if (is_stale[vertex]) {
+            is_stale[vertex] = false;
+            const int priority = ComputePriority(state, vertex, contracted_neighbours);
+            if (!queue.empty() && priority > queue.top().first) {
+                queue.push({priority, vertex});
+                continue;
+            }
+        }
+
+        ContractVertex(state, vertex, false);
+        state.contracted[vertex] = true;
+        rank_[vertex] = next_rank++;
+
+        for (const EdgeId arc_id : state.in_arcs[vertex]) {
+            const VertexId neighbour = arcs_[arc_id].from;
+            auto& out_arcs = state.out_arcs[neighbour];
+            out_arcs.erase(std::remove(out_arcs.begin(), out_arcs.end(), arc_id), out_arcs.end());
+            ++contracted_neighbours[neighbour];
+            is_stale[neighbour] = true;
+        }
+        for (const EdgeId arc_id : state.out_arcs[vertex]) {
+            const VertexId neighbour = arcs_[arc_id].to;
+            auto& in_arcs = state.in_arcs[neighbour];
+            in_arcs.erase(std::remove(in_arcs.begin(), in_arcs.end(), arc_id), in_arcs.end());
+            ++contracted_neighbours[neighbour];
+            is_stale[neighbour] = true;
+        }
+        std::vector<EdgeId>().swap(state.in_arcs[vertex]);
+        std::vector<EdgeId>().swap(state.out_arcs[vertex]);
+    }
+
+    BuildSearchGraphs();
+}
+
+template <typename Weight>
+ContractionHierarchy<Weight>::ContractionHierarchy(serialization::Reader& reader, const Graph& graph)
+    : vertex_count_(reader.ReadPod<uint64_t>())
+    , original_edge_count_(reader.ReadPod<uint64_t>())
+    , arcs_(reader.ReadVector<Arc>())
+    , rank_(reader.ReadVector<size_t>())
+    , upward_offsets_(reader.ReadVector<size_t>())
+    , upward_arcs_(reader.ReadVector<EdgeId>())
+    , downward_offsets_(reader.ReadVector<size_t>())
+    , downward_arcs_(reader.ReadVector<EdgeId>())
+{
+    if (vertex_count_ != graph.GetVertexCount() || original_edge_count_ != graph.GetEdgeCount()) {
+        throw serialization::FormatError("Contraction hierarchy does not match the graph");
+    }
+    CheckLoadedData();
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::CheckLoadedData() const {
+    auto fail = [] {
+        throw serialization::FormatError("Inconsistent contraction hierarchy data");
+    };
+    if (rank_.size() != vertex_count_ || arcs_.size() < original_edge_count_) {
+        fail();
+    }
+    // Порядок сжатия — перестановка вершин
+    std::vector<bool> is_rank_used(vertex_count_, false);
+    for (const size_t rank : rank_) {
+        if (rank >= vertex_count_ || is_rank_used[rank]) {
+            fail();
+        }
+        is_rank_used[rank] = true;
+    }
+    for (EdgeId arc_id = 0; arc_id < arcs_.size(); ++arc_id) {
+        const Arc& arc = arcs_[arc_id];
+        if (arc.from >= vertex_count_ || arc.to >= vertex_count_) {
+            fail();
+        }
+        // Исходное ребро не составное, сокращение составлено из двух более ранних дуг:
+        // так раскрытие сокращений всегда заканчивается
+        const bool is_original = arc_id < original_edge_count_;
+        if (is_original != (arc.first == NO_ARC) || is_original != (arc.second == NO_ARC)
+            || (!is_original && (arc.first >= arc_id || arc.second >= arc_id))) {
+            fail();
+        }
+    }
+    auto check_search_graph = [&](const std::vector<size_t>& offsets, const std::vector<EdgeId>& arc_ids,
+                                  bool is_backward) {
+        if (offsets.size() != vertex_count_ + 1 || offsets.front() != 0 || offsets.back() != arc_ids.size()) {
+            fail();
+        }
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            if (offsets[vertex + 1] < offsets[vertex]) {
+                fail();
+            }
+            for (size_t position = offsets[vertex]; position < offsets[vertex + 1]; ++position) {
+                if (arc_ids[position] >= arcs_.size()) {
+                    fail();
+                }
+                const Arc& arc = arcs_[arc_ids[position]];
+                // Поиск идёт только вверх по порядку, поэтому не зацикливается
+                const VertexId start = is_backward ? arc.to : arc.from;
+                const VertexId next = is_backward ? arc.from : arc.to;
+                if (start != vertex || rank_[next] <= rank_[vertex]) {
+                    fail();
+                }
+            }
+        }
+    };
+    check_search_graph(upward_offsets_, upward_arcs_, false);
+    check_search_graph(downward_offsets_, downward_arcs_, true);
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::Save(serialization::Writer& writer) const {
+    writer.WritePod<uint64_t>(vertex_count_);
+    writer.WritePod<uint64_t>(original_edge_count_);
+    writer.WriteVector(arcs_);
+    writer.WriteVector(rank_);
+    writer.WriteVector(upward_offsets_);
+    writer.WriteVector(upward_arcs_);
+    writer.WriteVector(downward_offsets_);
+    writer.WriteVector(downward_arcs_);
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::AddArc(ContractionState& state, const Arc& arc) {
+    if (arc.from == arc.to) {
+        return;  // петли не лежат на кратчайших путях
+    }
+    const EdgeId arc_id = arcs_.size() - 1;
+    // Из параллельных дуг в сжимаемом графе оставляем только самую лёгкую
+    for (EdgeId& existing_id : state.out_arcs[arc.from]) {
+        if (arcs_[existing_id].to != arc.to) {
+            continue;
+        }
+        if (arc.weight < arcs_[existing_id].weight) {
+            auto& in_arcs = state.in_arcs[arc.to];
+            std::replace(in_arcs.begin(), in_arcs.end(), existing_id, arc_id);
+            existing_id = arc_id;
+        }
+        return;
+    }
+    state.out_arcs[arc.from].push_back(arc_id);
+    state.in_arcs[arc.to].push_back(arc_id);
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::WitnessSearch(ContractionState& state, VertexId source,
+                                                 VertexId skipped, Weight max_weight,
+                                                 size_t settle_limit) const {
+    for (const VertexId vertex : state.witness_touched) {
+        state.witness_weights[vertex].reset();
+    }
+    state.witness_touched.clear();
+
+    MonotoneQueue<Weight> queue;
+    state.witness_weights[source] = ZERO_WEIGHT;
+    state.witness_touched.push_back(source);
+    queue.push({ZERO_WEIGHT, source});
+
+    size_t settled = 0;
+    size_t settled_targets = 0;
+    while (!queue.empty() && settled < settle_limit) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (*state.witness_weights[vertex] < weight) {
+            continue;
+        }
+        if (max_weight < weight) {
+            break;
+        }
+        ++settled;
+        if (state.is_target[vertex] && ++settled_targets == state.target_count) {
+            break;  // веса до всех концов окончательны
+        }
+        for (const EdgeId arc_id : state.out_arcs[vertex]) {
+            const Arc& arc = arcs_[arc_id];
+            if (arc.to == skipped) {
+                continue;
+            }
+            const Weight candidate_weight = weight + arc.weight;
+            auto& target_weight = state.witness_weights[arc.to];
+            if (!target_weight) {
+                state.witness_touched.push_back(arc.to);
+            }
+            if (!target_weight || candidate_weight < *target_weight) {
+                target_weight = candidate_weight;
+                queue.push({candidate_weight, arc.to});
+            }
+        }
+    }
+}
+
+template <typename Weight>
+size_t ContractionHierarchy<Weight>::ContractVertex(ContractionState& state, VertexId vertex,
+                                                    bool dry_run) {
+    // Копии: при добавлении сокращений списки соседей меняются
+    const std::vector<EdgeId> in_arcs = state.in_arcs[vertex];
+    const std::vector<EdgeId> out_arcs = state.out_arcs[vertex];
+    if (in_arcs.empty() || out_arcs.empty()) {
+        return 0;
+    }
+
+    Weight max_out_weight = ZERO_WEIGHT;
+    for (const EdgeId arc_id : out_arcs) {
+        max_out_weight = std::max(max_out_weight, arcs_[arc_id].weight);
+        state.is_target[arcs_[arc_id].to] = true;
+    }
+    // Параллельные дуги слиты в AddArc, поэтому концы исходящих дуг различны
+    state.target_count = out_arcs.size();
+    const size_t settle_limit = dry_run ? ESTIMATE_SETTLE_LIMIT : WITNESS_SETTLE_LIMIT;
+
+    size_t shortcut_count = 0;
+    for (const EdgeId in_arc_id : in_arcs) {
+        const VertexId source = arcs_[in_arc_id].from;
+        const Weight in_weight = arcs_[in_arc_id].weight;
+        WitnessSearch(state, source, vertex, in_weight + max_out_weight, settle_limit);
+
+        for (const EdgeId out_arc_id : out_arcs) {
+            const VertexId target = arcs_[out_arc_id].to;
+            if (target == source) {
+                continue;
+            }
+            const Weight via_weight = in_weight + arcs_[out_arc_id].weight;
+            const auto& witness_weight = state.witness_weights[target];
+            if (witness_weight && !(via_weight < *witness_weight)) {
+                continue;
+            }
+            ++shortcut_count;
+            if (!dry_run) {
+                arcs_.push_back(Arc{source, target, via_weight, in_arc_id, out_arc_id});
+                AddArc(state, arcs_.back());
+            }
+        }
+    }
+    for (const EdgeId arc_id : out_arcs) {
+        state.is_target[arcs_[arc_id].to] = false;
+    }
+    return shortcut_count;
+}
+
+template <typename Weight>
+int ContractionHierarchy<Weight>::ComputePriority(ContractionState& state, VertexId vertex,
+                                                  const std::vector<int>& contracted_neighbours) {
+    // Разность рёбер: сколько сокращений появится минус сколько дуг исчезнет
+    const int shortcut_count = static_cast<int>(ContractVertex(state, vertex, true));
+    const int removed_count =
+        static_cast<int>(state.in_arcs[vertex].size() + state.out_arcs[vertex].size());
+    return shortcut_count - removed_count + contracted_neighbours[vertex];
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::BuildSearchGraphs() {
+    upward_offsets_.assign(vertex_count_ + 1, 0);
+    downward_offsets_.assign(vertex_count_ + 1, 0);
+    for (const Arc& arc : arcs_) {
+        if (arc.from == arc.to) {
+            continue;
+        }
+        if (rank_[arc.from] < rank_[arc.to]) {
+            ++upward_offsets_[arc.from + 1];
+        } else {
+            ++downward_offsets_[arc.to + 1];
+        }
+    }
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        upward_offsets_[vertex + 1] += upward_offsets_[vertex];
+        downward_offsets_[vertex + 1] += downward_offsets_[vertex];
+    }
+
+    upward_arcs_.resize(upward_offsets_.back());
+    downward_arcs_.resize(downward_offsets_.back());
+    std::vector<size_t> upward_positions(upward_offsets_.begin(), upward_offsets_.end() - 1);
+    std::vector<size_t> downward_positions(downward_offsets_.begin(), downward_offsets_.end() - 1);
+    for (EdgeId arc_id = 0; arc_id < arcs_.size(); ++arc_id) {
+        const Arc& arc = arcs_[arc_id];
+        if (arc.from == arc.to) {
+            continue;
+        }
+        if (rank_[arc.from] < rank_[arc.to]) {
+            upward_arcs_[upward_positions[arc.from]++] = arc_id;
+        } else {
+            downward_arcs_[downward_positions[arc.to]++] = arc_id;
+        }
+    }
+}
+
+template <typename Weight>
+void ContractionHierarchy<Weight>::UnpackArc(EdgeId arc_id, std::vector<EdgeId>& edges) const {
+    std::vector<EdgeId> stack{arc_id};
+    while (!stack.empty()) {
+        const EdgeId current = stack.back();
+        stack.pop_back();
+        const Arc& arc = arcs_[current];
+        if (arc.first == NO_ARC) {
+            edges.push_back(current);
+        } else {
+            stack.push_back(arc.second);
+            stack.push_back(arc.first);
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename ContractionHierarchy<Weight>::Path> ContractionHierarchy<Weight>::FindPath(
+    VertexId from, VertexId to) const
+{
+    if (from >= vertex_count_ || to >= vertex_count_) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    if (from == to) {
+        return Path{ZERO_WEIGHT, {}};
+    }
+
+    struct Search {
+        std::vector<std::optional<Weight>> weights;
+        std::vector<EdgeId> parent_arcs;
+        MonotoneQueue<Weight> queue;
+    };
+    Search searches[2] = {
+        {std::vector<std::optional<Weight>>(vertex_count_), std::vector<EdgeId>(vertex_count_, NO_ARC), {}},
+        {std::vector<std::optional<Weight>>(vertex_count_), std::vector<EdgeId>(vertex_count_, NO_ARC), {}},
+    };
+    searches[0].weights[from] = ZERO_WEIGHT;
+    searches[0].queue.push({ZERO_WEIGHT, from});
+    searches[1].weights[to] = ZERO_WEIGHT;
+    searches[1].queue.push({ZERO_WEIGHT, to});
+
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = from;
+    size_t settled_vertices = 0;
+    auto is_exhausted = [&best_weight](const Search& search) {
+        return search.queue.empty() || (best_weight && !(search.queue.top().first < *best_weight));
+    };
+
+    while (!is_exhausted(searches[0]) || !is_exhausted(searches[1])) {
+        // Продвигаем направление с меньшим ключом
+        size_t direction = 0;
+        if (is_exhausted(searches[0])
+            || (!is_exhausted(searches[1])
+                && searches[1].queue.top().first < searches[0].queue.top().first)) {
+            direction = 1;
+        }
+        Search& search = searches[direction];
+        const Search& opposite = searches[1 - direction];
+
+        const auto [weight, vertex] = search.queue.top();
+        search.queue.pop();
+        if (*search.weights[vertex] < weight) {
+            continue;
+        }
+        ++settled_vertices;
+        if (const auto& opposite_weight = opposite.weights[vertex]) {
+            const Weight candidate_weight = weight + *opposite_weight;
+            if (!best_weight || candidate_weight < *best_weight) {
+                best_weight = candidate_weight;
+                meeting_vertex = vertex;
+            }
+        }
+
+        const auto& offsets = direction == 0 ? upward_offsets_ : downward_offsets_;
+        const auto& arc_ids = direction == 0 ? upward_arcs_ : downward_arcs_;
+        for (size_t position = offsets[vertex]; position < offsets[vertex + 1]; ++position) {
+            const EdgeId arc_id = arc_ids[position];
+            const Arc& arc = arcs_[arc_id];
+            const VertexId next = direction == 0 ? arc.to : arc.from;
+            const Weight candidate_weight = weight + arc.weight;
+            auto& next_weight = search.weights[next];
+            if (!next_weight || candidate_weight < *next_weight) {
+                next_weight = candidate_weight;
+                search.parent_arcs[next] = arc_id;
+                search.queue.push({candidate_weight, next});
+            }
+        }
+    }
+
+    if (!best_weight) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> forward_arcs;
+    for (VertexId vertex = meeting_vertex; searches[0].parent_arcs[vertex] != NO_ARC;
+         vertex = arcs_[searches[0].parent_arcs[vertex]].from) {
+        forward_arcs.push_back(searches[0].parent_arcs[vertex]);
+    }
+    std::reverse(forward_arcs.begin(), forward_arcs.end());
+
+    std::vector<EdgeId> edges;
+    for (const EdgeId arc_id : forward_arcs) {
+        UnpackArc(arc_id, edges);
+    }
+    for (VertexId vertex = meeting_vertex; searches[1].parent_arcs[vertex] != NO_ARC;
+         vertex = arcs_[searches[1].parent_arcs[vertex]].to) {
+        UnpackArc(searches[1].parent_arcs[vertex], edges);
+    }
+
+    return Path{*best_weight, std::move(edges), settled_vertices};
+}
+
+template <typename Weight>
+template <typename Callback>
+void ContractionHierarchy<Weight>::ForEachUpwardVertex(VertexId start, bool is_backward,
+                                                       Callback&& callback) const {
+    // Пространство поиска вверх мало по сравнению с графом: веса храним только для него
+    std::unordered_map<VertexId, Weight> weights;
+    MonotoneQueue<Weight> queue;
+    weights.emplace(start, ZERO_WEIGHT);
+    queue.push({ZERO_WEIGHT, start});
+
+    const auto& offsets = is_backward ? downward_offsets_ : upward_offsets_;
+    const auto& arc_ids = is_backward ? downward_arcs_ : upward_arcs_;
+    while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weights.at(vertex) < weight) {
+            continue;
+        }
+        callback(vertex, weight);
+        for (size_t position = offsets[vertex]; position < offsets[vertex + 1]; ++position) {
+            const Arc& arc = arcs_[arc_ids[position]];
+            const VertexId next = is_backward ? arc.from : arc.to;
+            const Weight candidate_weight = weight + arc.weight;
+            auto [it, inserted] = weights.try_emplace(next, candidate_weight);
+            if (inserted || candidate_weight < it->second) {
+                it->second = candidate_weight;
+                queue.push({candidate_weight, next});
+            }
+        }
+    }
+}
+
+template <typename Weight>
+std::vector<std::optional<Weight>> ContractionHierarchy<Weight>::FindWeightMatrix(
+    const std::vector<VertexId>& sources, const std::vector<VertexId>& targets) const
+{
+    for (const auto& vertices : {&sources, &targets}) {
+        for (const VertexId vertex : *vertices) {
+            if (vertex >= vertex_count_) {
+                throw std::out_of_range("Vertex id is out of range");
+            }
+        }
+    }
+
+    struct BucketEntry {
+        size_t target;  // индекс в targets
+        Weight weight;
+    };
+    // Обратные поиски независимы: каждый пишет в свой список
+    std::vector<std::vector<std::pair<VertexId, Weight>>> target_spaces(targets.size());
+    parallel::ForEachIndex(targets.size(), [&](size_t target) {
+        ForEachUpwardVertex(targets[target], true, [&](VertexId vertex, Weight weight) {
+            target_spaces[target].emplace_back(vertex, weight);
+        });
+    });
+
+    // Корзины в CSR: записи вершины v лежат в [bucket_offsets[v], bucket_offsets[v + 1])
+    std::vector<size_t> bucket_offsets(vertex_count_ + 1, 0);
+    for (const auto& space : target_spaces) {
+        for (const auto& [vertex, weight] : space) {
+            ++bucket_offsets[vertex + 1];
+        }
+    }
+    for (size_t vertex = 0; vertex < vertex_count_; ++vertex) {
+        bucket_offsets[vertex + 1] += bucket_offsets[vertex];
+    }
+    std::vector<BucketEntry> buckets(bucket_offsets.back());
+    std::vector<size_t> positions(bucket_offsets.begin(), bucket_offsets.end() - 1);
+    for (size_t target = 0; target < target_spaces.size(); ++target) {
+        for (const auto& [vertex, weight] : target_spaces[target]) {
+            buckets[positions[vertex]++] = {target, weight};
+        }
+    }
+
+    std::vector<std::optional<Weight>> matrix(sources.size() * targets.size());
+    parallel::ForEachIndex(sources.size(), [&](size_t source) {
+        std::optional<Weight>* row = matrix.data() + source * targets.size();
+        ForEachUpwardVertex(sources[source], false, [&](VertexId vertex, Weight weight) {
+            for (size_t i = bucket_offsets[vertex]; i < bucket_offsets[vertex + 1]; ++i) {
+                const Weight candidate_weight = weight + buckets[i].weight;
+                auto& cell = row[buckets[i].target];
+                if (!cell || candidate_weight < *cell) {
+                    cell = candidate_weight;
+                }
+            }
+        });
+    });
+    return matrix;
+}
+
+}  // namespace graph
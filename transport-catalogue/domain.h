@@ -2,20 +2,24 @@
 
 #include "geo.h"
 
-#include <string>
+#include <cstdint>
+#include <string_view>
 #include <vector>
 
 namespace transport::domain {
 
+// Имена хранит справочник, который создал остановку или автобус
 struct Stop {
-    std::string name;
+    std::string_view name;
     transport::geo::Coordinates coordinates; 
+    uint32_t id = 0;  // номер в каталоге по порядку добавления, без пропусков
 };
 
 struct Bus {
-    std::string name;
+    std::string_view name;
     std::vector<const Stop*> stops;
     bool is_circle = false;
+    uint32_t id = 0;  // номер в каталоге по порядку добавления; не переиспользуется после удаления
 };
 
 } // namespace transport::domain
\ No newline at end of file
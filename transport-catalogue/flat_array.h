@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace graph {
+
+// Плоский массив, который либо владеет своими элементами, либо ссылается на чужую память
+// только для чтения (например, на отображённый в память файл), удерживая её владельца
+template <typename T>
+class FlatArray {
+public:
+    FlatArray() = default;
+    FlatArray(const FlatArray&) = delete;
+    FlatArray& operator=(const FlatArray&) = delete;
+    FlatArray(FlatArray&&) = default;
+    FlatArray& operator=(FlatArray&&) = default;
+
+    void Assign(size_t size, const T& value) {
+        owned_.assign(size, value);
+        owner_.reset();
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+
+    void Attach(std::shared_ptr<const void> owner, const T* data, size_t size) {
+        std::vector<T>().swap(owned_);
+        owner_ = std::move(owner);
+        data_ = data;
+        size_ = size;
+    }
+
+    // Копирует чужие данные в собственный буфер, чтобы их можно было менять
+    void MakeOwned() {
+        if (owner_) {
+            owned_.assign(data_, data_ + size_);
+            owner_.reset();
+            data_ = owned_.data();
+        }
+    }
+
+    T* MutableData() {
+        if (owner_) {
+            throw std::logic_error("Cannot modify an attached array");
+        }
+        return owned_.data();
+    }
+
+    const T* Data() const {
+        return data_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+private:
+    std::vector<T> owned_;
+    std::shared_ptr<const void> owner_;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}  // namespace graph
@@ -1,8 +1,18 @@
 #pragma once
 
+#include "radix_heap.h"
 #include "ranges.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace graph {
@@ -17,59 +27,428 @@ struct Edge {
     Weight weight;
 };
 
+// Вес несуществующего пути. Для целых весов берём половину максимума, чтобы сумма двух
+// «бесконечностей» не переполнялась.
+template <typename Weight>
+inline constexpr Weight UNREACHABLE = std::numeric_limits<Weight>::has_infinity
+    ? std::numeric_limits<Weight>::infinity()
+    : std::numeric_limits<Weight>::max() / 2;
+// Последнее ребро пути, которого нет: у начальной вершины поиска и у недостижимых
+inline constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+// Очередь поиска Дейкстры: top() — запись с наименьшим весом
+template <typename Weight>
+using MinQueue = std::priority_queue<std::pair<Weight, VertexId>, std::vector<std::pair<Weight, VertexId>>,
+                                          std::greater<std::pair<Weight, VertexId>>>;
+// Очередь для поисков, где ключ новой записи не меньше последнего извлечённого (Дейкстра
+// без потенциала): радикс-куча для целых весов, двоичная куча для остальных
+template <typename Weight>
+using MonotoneQueue = std::conditional_t<std::is_integral_v<Weight>, RadixHeap<Weight, VertexId>, MinQueue<Weight>>;
+
+// Потенциал обычной Дейкстры для BuildShortestPaths
+template <typename Weight>
+struct ZeroPotential {
+    Weight operator()(VertexId) const {
+        return Weight{};
+    }
+};
+
 template <typename Weight>
 class DirectedWeightedGraph {
 private:
-    using IncidenceList = std::vector<EdgeId>;
+    // Номера вершин и рёбер внутри графа хранятся 32-битными
+    using Index = uint32_t;
+    using IncidenceList = std::vector<Index>;
     using IncidentEdgesRange = ranges::Range<typename IncidenceList::const_iterator>;
 
 public:
     DirectedWeightedGraph() = default;
     explicit DirectedWeightedGraph(size_t vertex_count);
     EdgeId AddEdge(const Edge<Weight>& edge);
+    VertexId AddVertex();
+    // Убирает ребро из списков смежности; его идентификатор не переиспользуется,
+    // а GetEdge по-прежнему возвращает его концы
+    void RemoveEdge(EdgeId edge_id);
+    bool IsEdgeRemoved(EdgeId edge_id) const;
+    // Меняет вес ребра; в замороженном графе правит и CSR-массивы
+    void SetEdgeWeight(EdgeId edge_id, Weight weight);
+
+    // Перекладывает рёбра в CSR-массивы (смещения, источники, цели, веса), сгруппированные
+    // по исходной вершине, и строит такие же обратные списки по конечной вершине.
+    // Идентификаторы рёбер не меняются; добавлять рёбра после этого нельзя.
+    void Freeze();
+    // Восстанавливает рёбра и списки смежности, чтобы снова добавлять рёбра и вершины
+    void Unfreeze();
+    bool IsFrozen() const;
 
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
-    const Edge<Weight>& GetEdge(EdgeId edge_id) const;
+    // Замороженный граф не хранит рёбра целиком, поэтому ребро возвращается по значению
+    Edge<Weight> GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    // Обходит исходящие рёбра вершины: callback(edge_id, to, weight)
+    template <typename Callback>
+    void ForEachOutgoingEdge(VertexId vertex, Callback&& callback) const;
+    // Обходит входящие рёбра вершины замороженного графа: callback(edge_id, from, weight)
+    template <typename Callback>
+    void ForEachIncomingEdge(VertexId vertex, Callback&& callback) const;
+
 private:
+    static constexpr size_t MAX_INDEX = std::numeric_limits<Index>::max();
+
+    size_t vertex_count_ = 0;
+    std::vector<bool> is_removed_;
+    // До Freeze(): рёбра по номерам и списки исходящих рёбер вершин
     std::vector<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
+
+    // После Freeze() рёбра лежат только в CSR-массивах: исходящие рёбра вершины v занимают
+    // позиции [offsets_[v], offsets_[v + 1]). Удалённые рёбра лежат за всеми живыми, чтобы
+    // GetEdge возвращал и их концы.
+    bool is_frozen_ = false;
+    std::vector<Index> offsets_;
+    std::vector<Index> sources_;
+    std::vector<Index> targets_;
+    std::vector<Weight> weights_;
+    std::vector<Index> edge_ids_;        // номер ребра на позиции
+    std::vector<Index> edge_positions_;  // позиция ребра по номеру
+    // Обратный CSR: позиции входящих рёбер вершины v в прямых массивах лежат
+    // в [reverse_offsets_[v], reverse_offsets_[v + 1]); источник и вес берутся оттуда же
+    std::vector<Index> reverse_offsets_;
+    std::vector<Index> reverse_positions_;
+};
+
+// Кратчайшие пути из одной вершины во все: вес пути (UNREACHABLE, если пути нет)
+// и его последнее ребро (NO_EDGE у начальной вершины и недостижимых)
+template <typename Weight>
+struct ShortestPaths {
+    std::vector<Weight> weights;
+    std::vector<EdgeId> prev_edges;
 };
 
+// Дейкстра из source во все вершины. Если is_backward, ищутся пути из всех вершин в source
+// по входящим рёбрам (граф должен быть заморожен), а prev_edges[v] — первое ребро пути v -> source.
+template <typename Weight>
+ShortestPaths<Weight> BuildShortestPaths(const DirectedWeightedGraph<Weight>& graph, VertexId source,
+                                         bool is_backward = false);
+// То же с остановкой: поиск заканчивается, как только извлечена target, и у неизвлечённых
+// вершин остаются предварительные веса. Ключ очереди — вес пути плюс get_potential(v), нижняя
+// оценка пути от v до target, согласованная с весами рёбер (A*). settled_vertices, если задан,
+// увеличивается на число извлечённых вершин. С ZeroPotential очередь — MonotoneQueue; с оценкой —
+// двоичная куча: приближённо согласованная оценка может сделать ключи убывающими.
+template <typename Weight, typename GetPotential>
+ShortestPaths<Weight> BuildShortestPaths(const DirectedWeightedGraph<Weight>& graph, VertexId source,
+                                         bool is_backward, std::optional<VertexId> target,
+                                         GetPotential&& get_potential, size_t* settled_vertices = nullptr);
+
+// Затрагивают ли изменённые рёбра кратчайшие пути из одной вершины (в неё, если is_backward):
+// get_weight(v) — вес пути от v или до v (UNREACHABLE, если пути нет), get_prev_edge(v) — ребро
+// пути, ближайшее к v, или NO_EDGE. Путь затронут, если проходит по изменённому ребру или может
+// через него сократиться. tolerance — относительный запас для весов, хранящихся с потерей точности.
+template <typename Weight, typename GetWeight, typename GetPrevEdge>
+bool IsAffectedByEdges(const DirectedWeightedGraph<Weight>& graph, const std::vector<EdgeId>& changed_edges,
+                       GetWeight&& get_weight, GetPrevEdge&& get_prev_edge, bool is_backward = false,
+                       Weight tolerance = Weight{});
+
 template <typename Weight>
 DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
-    : incidence_lists_(vertex_count) {
+    : vertex_count_(vertex_count)
+    , incidence_lists_(vertex_count) {
+    if (vertex_count > MAX_INDEX) {
+        throw std::length_error("Too many vertices");
+    }
 }
 
 template <typename Weight>
 EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+    if (is_frozen_) {
+        throw std::logic_error("Cannot add an edge to a frozen graph");
+    }
+    if (edge.to >= vertex_count_) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    if (edges_.size() >= MAX_INDEX) {
+        throw std::length_error("Too many edges");
+    }
+    incidence_lists_.at(edge.from).push_back(static_cast<Index>(edges_.size()));
     edges_.push_back(edge);
-    const EdgeId id = edges_.size() - 1;
-    incidence_lists_.at(edge.from).push_back(id);
-    return id;
+    is_removed_.push_back(false);
+    return edges_.size() - 1;
+}
+
+template <typename Weight>
+VertexId DirectedWeightedGraph<Weight>::AddVertex() {
+    if (is_frozen_) {
+        throw std::logic_error("Cannot add a vertex to a frozen graph");
+    }
+    if (vertex_count_ >= MAX_INDEX) {
+        throw std::length_error("Too many vertices");
+    }
+    incidence_lists_.emplace_back();
+    return vertex_count_++;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::RemoveEdge(EdgeId edge_id) {
+    if (is_frozen_) {
+        throw std::logic_error("Cannot remove an edge from a frozen graph");
+    }
+    if (is_removed_.at(edge_id)) {
+        return;
+    }
+    auto& incidence_list = incidence_lists_[edges_[edge_id].from];
+    incidence_list.erase(std::find(incidence_list.begin(), incidence_list.end(), edge_id));
+    is_removed_[edge_id] = true;
+}
+
+template <typename Weight>
+bool DirectedWeightedGraph<Weight>::IsEdgeRemoved(EdgeId edge_id) const {
+    return is_removed_.at(edge_id);
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::SetEdgeWeight(EdgeId edge_id, Weight weight) {
+    if (!is_frozen_) {
+        edges_.at(edge_id).weight = weight;
+        return;
+    }
+    // Обратный CSR ссылается на те же позиции, поэтому вес хранится в одном месте
+    weights_[edge_positions_.at(edge_id)] = weight;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Freeze() {
+    if (is_frozen_) {
+        return;
+    }
+
+    offsets_.assign(vertex_count_ + 1, 0);
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        offsets_[vertex + 1] = offsets_[vertex] + static_cast<Index>(incidence_lists_[vertex].size());
+    }
+
+    // Живые рёбра — по исходным вершинам в порядке списков смежности, удалённые — в конце
+    const size_t edge_count = edges_.size();
+    sources_.resize(edge_count);
+    targets_.resize(edge_count);
+    weights_.resize(edge_count);
+    edge_ids_.resize(edge_count);
+    edge_positions_.resize(edge_count);
+    auto place = [&](Index position, Index edge_id) {
+        const auto& edge = edges_[edge_id];
+        sources_[position] = static_cast<Index>(edge.from);
+        targets_[position] = static_cast<Index>(edge.to);
+        weights_[position] = edge.weight;
+        edge_ids_[position] = edge_id;
+        edge_positions_[edge_id] = position;
+    };
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        Index position = offsets_[vertex];
+        for (const Index edge_id : incidence_lists_[vertex]) {
+            place(position++, edge_id);
+        }
+    }
+    Index removed_position = offsets_[vertex_count_];
+    for (Index edge_id = 0; edge_id < edge_count; ++edge_id) {
+        if (is_removed_[edge_id]) {
+            place(removed_position++, edge_id);
+        }
+    }
+
+    const Index live_edge_count = offsets_[vertex_count_];
+    reverse_offsets_.assign(vertex_count_ + 1, 0);
+    for (Index position = 0; position < live_edge_count; ++position) {
+        ++reverse_offsets_[targets_[position] + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        reverse_offsets_[vertex + 1] += reverse_offsets_[vertex];
+    }
+
+    reverse_positions_.resize(live_edge_count);
+    std::vector<Index> next_positions(reverse_offsets_.begin(), reverse_offsets_.end() - 1);
+    // Входящие рёбра вершины упорядочены по номерам, как при обходе рёбер по порядку
+    for (Index edge_id = 0; edge_id < edge_count; ++edge_id) {
+        if (!is_removed_[edge_id]) {
+            reverse_positions_[next_positions[edges_[edge_id].to]++] = edge_positions_[edge_id];
+        }
+    }
+
+    // Рёбра и списки смежности теперь лежат в CSR-массивах: освобождаем их
+    std::vector<Edge<Weight>>().swap(edges_);
+    std::vector<IncidenceList>().swap(incidence_lists_);
+    is_frozen_ = true;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Unfreeze() {
+    if (!is_frozen_) {
+        return;
+    }
+    edges_.resize(edge_ids_.size());
+    for (Index position = 0; position < edge_ids_.size(); ++position) {
+        edges_[edge_ids_[position]] = {sources_[position], targets_[position], weights_[position]};
+    }
+    incidence_lists_.assign(vertex_count_, {});
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        incidence_lists_[vertex].assign(edge_ids_.begin() + offsets_[vertex],
+                                        edge_ids_.begin() + offsets_[vertex + 1]);
+    }
+    std::vector<Index>().swap(offsets_);
+    std::vector<Index>().swap(sources_);
+    std::vector<Index>().swap(targets_);
+    std::vector<Weight>().swap(weights_);
+    std::vector<Index>().swap(edge_ids_);
+    std::vector<Index>().swap(edge_positions_);
+    std::vector<Index>().swap(reverse_offsets_);
+    std::vector<Index>().swap(reverse_positions_);
+    is_frozen_ = false;
+}
+
+template <typename Weight>
+bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+    return is_frozen_;
 }
 
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return vertex_count_;
 }
 
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetEdgeCount() const {
-    return edges_.size();
+    return is_removed_.size();
 }
 
 template <typename Weight>
-const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
+Edge<Weight> DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
+    if (is_frozen_) {
+        const Index position = edge_positions_.at(edge_id);
+        return {sources_[position], targets_[position], weights_[position]};
+    }
     return edges_.at(edge_id);
 }
 
 template <typename Weight>
 typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    if (is_frozen_) {
+        if (vertex >= vertex_count_) {
+            throw std::out_of_range("Vertex id is out of range");
+        }
+        return IncidentEdgesRange{edge_ids_.begin() + offsets_[vertex],
+                                  edge_ids_.begin() + offsets_[vertex + 1]};
+    }
     return ranges::AsRange(incidence_lists_.at(vertex));
 }
 
-}  // namespace graph
\ No newline at end of file
+template <typename Weight>
+template <typename Callback>
+void DirectedWeightedGraph<Weight>::ForEachOutgoingEdge(VertexId vertex, Callback&& callback) const {
+    if (is_frozen_) {
+        const Index end = offsets_[vertex + 1];
+        for (Index position = offsets_[vertex]; position < end; ++position) {
+            callback(EdgeId{edge_ids_[position]}, VertexId{targets_[position]}, weights_[position]);
+        }
+        return;
+    }
+    for (const Index edge_id : incidence_lists_[vertex]) {
+        const auto& edge = edges_[edge_id];
+        callback(EdgeId{edge_id}, edge.to, edge.weight);
+    }
+}
+
+template <typename Weight>
+template <typename Callback>
+void DirectedWeightedGraph<Weight>::ForEachIncomingEdge(VertexId vertex, Callback&& callback) const {
+    if (!is_frozen_) {
+        throw std::logic_error("Incoming edges are available only for a frozen graph");
+    }
+    const Index end = reverse_offsets_[vertex + 1];
+    for (Index reverse_position = reverse_offsets_[vertex]; reverse_position < end; ++reverse_position) {
+        const Index position = reverse_positions_[reverse_position];
+        callback(EdgeId{edge_ids_[position]}, VertexId{sources_[position]}, weights_[position]);
+    }
+}
+
+template <typename Weight>
+ShortestPaths<Weight> BuildShortestPaths(const DirectedWeightedGraph<Weight>& graph, VertexId source,
+                                         bool is_backward) {
+    return BuildShortestPaths(graph, source, is_backward, std::nullopt, ZeroPotential<Weight>{});
+}
+
+template <typename Weight, typename GetPotential>
+ShortestPaths<Weight> BuildShortestPaths(const DirectedWeightedGraph<Weight>& graph, VertexId source,
+                                         bool is_backward, std::optional<VertexId> target,
+                                         GetPotential&& get_potential, size_t* settled_vertices) {
+    const size_t vertex_count = graph.GetVertexCount();
+    if (source >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    ShortestPaths<Weight> paths{std::vector<Weight>(vertex_count, UNREACHABLE<Weight>),
+                                std::vector<EdgeId>(vertex_count, NO_EDGE)};
+    std::vector<bool> settled(vertex_count, false);
+    constexpr bool is_monotone = std::is_same_v<std::decay_t<GetPotential>, ZeroPotential<Weight>>;
+    std::conditional_t<is_monotone, MonotoneQueue<Weight>, MinQueue<Weight>> queue;
+    paths.weights[source] = Weight{};
+    queue.push({get_potential(source), source});
+    while (!queue.empty()) {
+        const VertexId vertex = queue.top().second;
+        queue.pop();
+        if (settled[vertex]) {
+            continue;  // устаревшая запись в очереди
+        }
+        settled[vertex] = true;
+        if (settled_vertices) {
+            ++*settled_vertices;
+        }
+        if (vertex == target) {
+            break;
+        }
+        const Weight weight = paths.weights[vertex];
+        auto relax = [&](EdgeId edge_id, VertexId next, Weight edge_weight) {
+            const Weight candidate_weight = weight + edge_weight;
+            if (!settled[next] && candidate_weight < paths.weights[next]) {
+                paths.weights[next] = candidate_weight;
+                paths.prev_edges[next] = edge_id;
+                queue.push({candidate_weight + get_potential(next), next});
+            }
+        };
+        if (is_backward) {
+            graph.ForEachIncomingEdge(vertex, relax);
+        } else {
+            graph.ForEachOutgoingEdge(vertex, relax);
+        }
+    }
+    return paths;
+}
+
+template <typename Weight, typename GetWeight, typename GetPrevEdge>
+bool IsAffectedByEdges(const DirectedWeightedGraph<Weight>& graph, const std::vector<EdgeId>& changed_edges,
+                       GetWeight&& get_weight, GetPrevEdge&& get_prev_edge, bool is_backward,
+                       Weight tolerance) {
+    for (const EdgeId edge_id : changed_edges) {
+        const auto& edge = graph.GetEdge(edge_id);
+        // Обратный поиск проходит ребро от конца к началу
+        const VertexId nearer = is_backward ? edge.to : edge.from;
+        const VertexId farther = is_backward ? edge.from : edge.to;
+        if (get_prev_edge(farther) == edge_id) {
+            return true;
+        }
+        if (graph.IsEdgeRemoved(edge_id)) {
+            continue;
+        }
+        const Weight weight_nearer = get_weight(nearer);
+        const Weight weight_farther = get_weight(farther);
+        if (weight_nearer == UNREACHABLE<Weight>) {
+            continue;
+        }
+        if (weight_farther == UNREACHABLE<Weight>
+            || weight_nearer + edge.weight < weight_farther + weight_farther * tolerance) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace graph
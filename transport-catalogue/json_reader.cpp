@@ -6,6 +6,9 @@
 #include <set>
 #include <algorithm>
 #include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <future>
 
 namespace transport::json_reader {
 
@@ -27,23 +30,37 @@ void JSONReader::ProcessRequests(std::istream& in, std::ostream& out) {
     ProcessStops(base_requests);
     ProcessDistances(base_requests);
     ProcessBusses(base_requests);
+    catalogue_.Finalize();
 
-    transport::routing::RoutingSettings routing_settings;
+    std::optional<transport::routing::RoutingSettings> routing_settings;
     if (root_map.count("routing_settings"s)) {
-        const auto& rs = root_map.at("routing_settings"s).AsMap();
-        routing_settings.bus_wait_time = rs.at("bus_wait_time"s).AsInt();
-        routing_settings.bus_velocity = rs.at("bus_velocity"s).AsDouble();
-        transport_router_.emplace(catalogue_, routing_settings);
+        routing_settings = ReadRoutingSettings(root_map.at("routing_settings"s).AsMap());
     }
 
     // Обрабатываем stat_requests если они есть
     if (root_map.count("stat_requests"s)) {
         const auto& stat_requests = root_map.at("stat_requests"s).AsArray();
-        
+
+        // Маршрутизатор нужен только запросам Route, Reachable, Matrix и RouterStats:
+        // без них его не строим вовсе. Если такой запрос в пакете есть, построение начинается
+        // сразу, а не при первом из них: оно идёт в фоне одновременно с ответами на Bus, Stop
+        // и Map, стоящие раньше, и первому запросу к маршрутизатору остаётся ждать меньше.
+        const bool needs_router = std::any_of(stat_requests.begin(), stat_requests.end(),
+            [](const json::Node& request) {
+                std::string_view type = request.AsMap().at("type"s).AsString();
+                return type == "Route"sv || type == "Reachable"sv || type == "Matrix"sv
+                    || type == "RouterStats"sv;
+            });
+        if (routing_settings && needs_router) {
+            StartRouterBuild(*routing_settings);
+        }
+
         json::Array responses;
+        // Ответы Route пачкой считаются при первом запросе Route
+        std::optional<std::vector<std::optional<transport::routing::RouteInfo>>> routes;
 
-        for (const auto& request_node : stat_requests) {
-            const auto& req_map = request_node.AsMap();
+        for (size_t request_index = 0; request_index < stat_requests.size(); ++request_index) {
+            const auto& req_map = stat_requests[request_index].AsMap();
             int id = req_map.at("id"s).AsInt();
             std::string_view req_type = req_map.at("type"s).AsString();
 
@@ -59,12 +76,35 @@ void JSONReader::ProcessRequests(std::istream& in, std::ostream& out) {
                 ProcessMap(builder, render_settings);
             } 
             else if (req_type == "Route"sv) {
-                if (!transport_router_) {
+                if (!routing_settings) {
                     builder.Key("error_message").Value("routing settings not provided"s);
+                } else if (req_map.count("max_transfers"s)) {
+                    RequestParetoRoutes(builder, req_map);
+                } else if (HasRouteStats(req_map)) {
+                    RequestRouteWithStats(builder, req_map);
                 } else {
-                    RequestRoute(builder, req_map, routing_settings);
+                    if (!routes) {
+                        routes = BuildRoutesBatch(stat_requests, request_index);
+                    }
+                    RequestRoute(builder, (*routes)[request_index]);
                 }
-            } 
+            }
+            else if (req_type == "Reachable"sv || req_type == "Matrix"sv || req_type == "RouterStats"sv) {
+                if (!routing_settings) {
+                    builder.Key("error_message").Value("routing settings not provided"s);
+                } else if (req_type == "Reachable"sv) {
+                    RequestReachable(builder, req_map);
+                } else if (req_type == "Matrix"sv) {
+                    RequestMatrix(builder, req_map);
+                } else {
+                    RequestRouterStats(builder);
+                }
+            }
+            else if (IsUpdateRequest(req_type)) {
+                RequestUpdate(builder, req_type, req_map);
+                // Следующие Route считаются уже по изменённому графу
+                routes.reset();
+            }
             else {
                 builder.Key("error_message").Value("unknown request type"s);
             }
@@ -83,10 +123,10 @@ void JSONReader::ProcessStops(const json::Array& base_requests)
         const auto& req_map = request_node.AsMap();
         std::string_view type = req_map.at("type"s).AsString();
         if (type == "Stop"sv) {
-            std::string name = req_map.at("name"s).AsString();
+            std::string_view name = req_map.at("name"s).AsString();
             double lat = req_map.at("latitude"s).AsDouble();
             double lon = req_map.at("longitude"s).AsDouble();
-            catalogue_.AddStop(std::move(name), lat, lon);
+            catalogue_.AddStop(name, lat, lon);
         }
     }
 }
@@ -118,17 +158,21 @@ void JSONReader::ProcessBusses(const json::Array& base_requests)
         const auto& req_map = request_node.AsMap();
         std::string_view type = req_map.at("type"s).AsString();
         if (type == "Bus"sv) {
-            std::string name = req_map.at("name"s).AsString();
-            bool is_circle = req_map.at("is_roundtrip"s).AsBool();
+            AddBus(req_map);
+        }
+    }
+}
 
-            std::vector<std::string> stop_names;
-            for (const auto& stop_node : req_map.at("stops"s).AsArray()) {
-                stop_names.emplace_back(stop_node.AsString());
-            }
+void JSONReader::AddBus(const json::Dict& req_map) {
+    std::string_view name = req_map.at("name"s).AsString();
+    bool is_circle = req_map.at("is_roundtrip"s).AsBool();
 
-            catalogue_.AddBus(std::move(name), stop_names, is_circle);
-        }
+    std::vector<std::string_view> stop_names;
+    for (const auto& stop_node : req_map.at("stops"s).AsArray()) {
+        stop_names.emplace_back(stop_node.AsString());
     }
+
+    catalogue_.AddBus(name, stop_names, is_circle);
 }
 
 void JSONReader::RequestBus(json::Builder& builder, const json::Dict& req_map) const {
@@ -146,14 +190,11 @@ void JSONReader::RequestBus(json::Builder& builder, const json::Dict& req_map) c
 
 void JSONReader::RequestStop(json::Builder& builder, const json::Dict& req_map) const {
     std::string_view stop_name = req_map.at("name"s).AsString();
-    if (auto buses_opt = transport::request_handler::GetBusesByStop(stop_name, catalogue_)) {
-        const auto& buses = **buses_opt;
-        std::vector<std::string> names(buses.begin(), buses.end());
-        std::sort(names.begin(), names.end());
-
+    if (auto buses = transport::request_handler::GetBusesByStop(stop_name, catalogue_)) {
+        // Автобусы уже упорядочены по именам
         json::Array arr;
-        for (const auto& name : names) {
-            arr.push_back(json::Node(name));
+        for (const uint32_t bus_id : *buses) {
+            arr.push_back(json::Node(std::string(catalogue_.GetBus(bus_id).name)));
         }
         builder.Key("buses").Value(std::move(arr));
     }
@@ -223,35 +264,320 @@ svg::Color JSONReader::ReadColor(const json::Node& color_node) {
     return "black"s;
 }
 
+transport::routing::RoutingSettings JSONReader::ReadRoutingSettings(const json::Dict& routing_settings_map) {
+    transport::routing::RoutingSettings settings;
+
+    settings.bus_wait_time = routing_settings_map.at("bus_wait_time"s).AsInt();
+    settings.bus_velocity = routing_settings_map.at("bus_velocity"s).AsDouble();
+
+    // Необязательный режим маршрутизатора: "all_pairs" (по умолчанию), "all_pairs_compact",
+    // "on_demand", "contraction_hierarchies", "a_star" или "bidirectional"
+    if (auto it = routing_settings_map.find("router_mode"s); it != routing_settings_map.end()) {
+        const std::string& mode = it->second.AsString();
+        if (mode == "all_pairs"sv) {
+            settings.router_mode = graph::RouterMode::ALL_PAIRS;
+        } else if (mode == "on_demand"sv) {
+            settings.router_mode = graph::RouterMode::ON_DEMAND;
+        } else if (mode == "contraction_hierarchies"sv) {
+            settings.router_mode = graph::RouterMode::CONTRACTION_HIERARCHIES;
+        } else if (mode == "a_star"sv) {
+            settings.router_mode = graph::RouterMode::A_STAR;
+        } else if (mode == "bidirectional"sv) {
+            settings.router_mode = graph::RouterMode::BIDIRECTIONAL;
+        } else if (mode == "all_pairs_compact"sv) {
+            settings.router_mode = graph::RouterMode::ALL_PAIRS_COMPACT;
+        } else {
+            throw std::invalid_argument("unknown router_mode: "s + mode);
+        }
+    }
+    // Необязательная модель графа: "stop_pairs" или "route_pattern". По умолчанию stop_pairs,
+    // а для contraction_hierarchies — route_pattern: сжимать плотный граф stop_pairs намного дольше
+    if (auto it = routing_settings_map.find("graph_model"s); it != routing_settings_map.end()) {
+        const std::string& model = it->second.AsString();
+        if (model == "stop_pairs"sv) {
+            settings.graph_model = transport::routing::GraphModel::STOP_PAIRS;
+        } else if (model == "route_pattern"sv) {
+            settings.graph_model = transport::routing::GraphModel::ROUTE_PATTERN;
+        } else {
+            throw std::invalid_argument("unknown graph_model: "s + model);
+        }
+    } else if (settings.router_mode == graph::RouterMode::CONTRACTION_HIERARCHIES) {
+        settings.graph_model = transport::routing::GraphModel::ROUTE_PATTERN;
+    }
+    // Необязательный движок поиска: "graph" (по умолчанию) или "raptor"
+    if (auto it = routing_settings_map.find("routing_engine"s); it != routing_settings_map.end()) {
+        const std::string& engine = it->second.AsString();
+        if (engine == "graph"sv) {
+            settings.routing_engine = transport::routing::RoutingEngine::GRAPH;
+        } else if (engine == "raptor"sv) {
+            settings.routing_engine = transport::routing::RoutingEngine::RAPTOR;
+        } else {
+            throw std::invalid_argument("unknown routing_engine: "s + engine);
+        }
+    }
+    // Необязательные веса графа: "minutes" (по умолчанию, double) или "centiseconds" (целые)
+    if (auto it = routing_settings_map.find("weight_type"s); it != routing_settings_map.end()) {
+        const std::string& weight_type = it->second.AsString();
+        if (weight_type == "minutes"sv) {
+            settings.weight_type = transport::routing::WeightType::MINUTES;
+        } else if (weight_type == "centiseconds"sv) {
+            settings.weight_type = transport::routing::WeightType::CENTISECONDS;
+        } else {
+            throw std::invalid_argument("unknown weight_type: "s + weight_type);
+        }
+    }
+    // Файл, где хранятся построенный граф и таблицы маршрутизатора между запусками
+    if (auto it = routing_settings_map.find("cache_file"s); it != routing_settings_map.end()) {
+        settings.cache_file = it->second.AsString();
+    }
+    // Число ориентиров ALT для режима a_star
+    if (auto it = routing_settings_map.find("landmark_count"s); it != routing_settings_map.end()) {
+        const int landmark_count = it->second.AsInt();
+        if (landmark_count < 0) {
+            throw std::invalid_argument("landmark_count must be non-negative"s);
+        }
+        settings.landmark_count = static_cast<size_t>(landmark_count);
+    }
+    // Бюджет кэша деревьев кратчайших путей в мегабайтах
+    if (auto it = routing_settings_map.find("tree_cache_mb"s); it != routing_settings_map.end()) {
+        const int tree_cache_mb = it->second.AsInt();
+        if (tree_cache_mb < 0) {
+            throw std::invalid_argument("tree_cache_mb must be non-negative"s);
+        }
+        settings.tree_cache_budget = static_cast<size_t>(tree_cache_mb) * 1024 * 1024;
+    }
+
+    return settings;
+}
+
+void JSONReader::StartRouterBuild(const transport::routing::RoutingSettings& routing_settings) {
+    // Справочник дальше только читается, поэтому строить маршрутизатор можно параллельно
+    // с ответами на запросы Bus, Stop и Map
+    router_build_ = std::async(std::launch::async, [this, routing_settings] {
+        transport_router_.emplace(catalogue_, routing_settings);
+    });
+}
+
+const transport::routing::TransportRouter& JSONReader::GetRouter() const {
+    if (router_build_.valid()) {
+        // get() пробрасывает исключение, если построение не удалось
+        router_build_.get();
+    }
+    if (!transport_router_) {
+        throw std::logic_error("Transport router is not built");
+    }
+    return *transport_router_;
+}
+
+std::vector<std::optional<transport::routing::RouteInfo>> JSONReader::BuildRoutesBatch(
+    const json::Array& stat_requests, size_t begin) const
+{
+    std::vector<std::optional<transport::routing::RouteInfo>> routes(stat_requests.size());
+    const auto& router = GetRouter();
+
+    // Группируем запросы по остановке отправления, сохраняя индексы для исходного порядка
+    std::unordered_map<std::string_view, std::vector<size_t>> requests_by_origin;
+    for (size_t i = begin; i < stat_requests.size(); ++i) {
+        const auto& req_map = stat_requests[i].AsMap();
+        if (IsUpdateRequest(req_map.at("type"s).AsString())) {
+            break;
+        }
+        if (req_map.at("type"s).AsString() == "Route"sv && !req_map.count("max_transfers"s)
+            && !HasRouteStats(req_map)) {
+            requests_by_origin[req_map.at("from"s).AsString()].push_back(i);
+        }
+    }
+
+    for (const auto& [from, request_indices] : requests_by_origin) {
+        std::vector<std::string_view> destinations;
+        destinations.reserve(request_indices.size());
+        for (size_t i : request_indices) {
+            destinations.push_back(stat_requests[i].AsMap().at("to"s).AsString());
+        }
+        auto origin_routes = router.BuildRoutes(from, destinations);
+        for (size_t j = 0; j < request_indices.size(); ++j) {
+            routes[request_indices[j]] = std::move(origin_routes[j]);
+        }
+    }
+    return routes;
+}
+
+json::Array JSONReader::MakeRouteItems(const transport::routing::RouteInfo& route) const {
+    json::Array items;
+    for (const auto& item : route.items) {
+        json::Dict item_dict;
+        if (item.type == transport::routing::RoutingItem::Type::WAIT) {
+            item_dict["type"] = json::Node("Wait"s);
+            item_dict["stop_name"] = json::Node(item.stop_name);
+            item_dict["time"] = json::Node(item.time);
+        } else {
+            item_dict["type"] = json::Node("Bus"s);
+            item_dict["bus"] = json::Node(item.bus_name);
+            item_dict["span_count"] = json::Node(static_cast<int>(item.span_count));
+            item_dict["time"] = json::Node(item.time);
+        }
+        items.push_back(json::Node(std::move(item_dict)));
+    }
+    return items;
+}
+
 void JSONReader::RequestRoute(
     json::Builder& builder,
-    const json::Dict& req_map,
-    const transport::routing::RoutingSettings&) const
+    const std::optional<transport::routing::RouteInfo>& route) const
 {
-    std::string_view from = req_map.at("from"s).AsString();
-    std::string_view to = req_map.at("to"s).AsString();
-
-    if (auto route = transport_router_->BuildRoute(from, to)) {
+    if (route) {
         builder.Key("total_time").Value(route->total_time);
+        builder.Key("items").Value(MakeRouteItems(*route));
+    } else {
+        builder.Key("error_message").Value("not found"s);
+    }
+}
 
-        json::Array items;
-        for (const auto& item : route->items) {
-            json::Dict item_dict;
-            if (item.type == transport::routing::RoutingItem::Type::WAIT) {
-                item_dict["type"] = json::Node("Wait"s);
-                item_dict["stop_name"] = json::Node(item.stop_name);
-                item_dict["time"] = json::Node(item.time);
-            } else {
-                item_dict["type"] = json::Node("Bus"s);
-                item_dict["bus"] = json::Node(item.bus_name);
-                item_dict["span_count"] = json::Node(static_cast<int>(item.span_count));
-                item_dict["time"] = json::Node(item.time);
-            }
-            items.push_back(json::Node(std::move(item_dict)));
+bool JSONReader::HasRouteStats(const json::Dict& req_map) {
+    const auto it = req_map.find("stats"s);
+    return it != req_map.end() && it->second.AsBool();
+}
+
+void JSONReader::RequestRouteWithStats(json::Builder& builder, const json::Dict& req_map) const {
+    // Отдельный поиск: в пакете одно дерево обслуживает все запросы с той же остановкой
+    const auto route = GetRouter().BuildRoute(req_map.at("from"s).AsString(), req_map.at("to"s).AsString());
+    RequestRoute(builder, route);
+    if (route) {
+        builder.Key("settled_vertices").Value(static_cast<int>(route->settled_vertices));
+    }
+}
+
+void JSONReader::RequestParetoRoutes(json::Builder& builder, const json::Dict& req_map) const {
+    const int max_transfers = req_map.at("max_transfers"s).AsInt();
+    if (max_transfers < 0) {
+        builder.Key("error_message").Value("invalid max_transfers"s);
+        return;
+    }
+    const auto routes = GetRouter().BuildParetoRoutes(
+        req_map.at("from"s).AsString(), req_map.at("to"s).AsString(), static_cast<size_t>(max_transfers));
+    if (routes.empty()) {
+        builder.Key("error_message").Value("not found"s);
+        return;
+    }
+
+    // Варианты по возрастанию числа пересадок, каждый следующий быстрее предыдущего
+    json::Array variants;
+    for (const auto& route : routes) {
+        const auto bus_items = std::count_if(route.items.begin(), route.items.end(), [](const auto& item) {
+            return item.type == transport::routing::RoutingItem::Type::BUS;
+        });
+        json::Dict variant;
+        variant["total_time"] = json::Node(route.total_time);
+        variant["transfers"] = json::Node(static_cast<int>(std::max<std::ptrdiff_t>(bus_items - 1, 0)));
+        variant["items"] = json::Node(MakeRouteItems(route));
+        variants.push_back(json::Node(std::move(variant)));
+    }
+    builder.Key("routes").Value(std::move(variants));
+}
+
+void JSONReader::RequestReachable(json::Builder& builder, const json::Dict& req_map) const {
+    const double max_time = req_map.at("max_time"s).AsDouble();
+    if (max_time < 0.0) {
+        builder.Key("error_message").Value("invalid max_time"s);
+        return;
+    }
+    const auto stops = GetRouter().FindReachableStops(req_map.at("from"s).AsString(), max_time);
+    if (!stops) {
+        builder.Key("error_message").Value("not found"s);
+        return;
+    }
+
+    json::Array items;
+    for (const auto& stop : *stops) {
+        json::Dict item;
+        item["stop_name"] = json::Node(stop.stop_name);
+        item["time"] = json::Node(stop.time);
+        items.push_back(json::Node(std::move(item)));
+    }
+    builder.Key("stops").Value(std::move(items));
+}
+
+void JSONReader::RequestMatrix(json::Builder& builder, const json::Dict& req_map) const {
+    auto read_stops = [&req_map](const std::string& key) {
+        std::vector<std::string_view> stops;
+        for (const auto& stop_node : req_map.at(key).AsArray()) {
+            stops.push_back(stop_node.AsString());
+        }
+        return stops;
+    };
+    const auto from = read_stops("from"s);
+    const auto to = read_stops("to"s);
+    const auto times = GetRouter().BuildTimeMatrix(from, to);
+
+    // Строка на каждую остановку from; null там, где маршрута нет
+    json::Array rows;
+    rows.reserve(from.size());
+    for (size_t i = 0; i < from.size(); ++i) {
+        json::Array row;
+        row.reserve(to.size());
+        for (size_t j = 0; j < to.size(); ++j) {
+            const auto& time = times[i * to.size() + j];
+            row.push_back(time ? json::Node(*time) : json::Node(nullptr));
+        }
+        rows.push_back(json::Node(std::move(row)));
+    }
+    builder.Key("times").Value(std::move(rows));
+}
+
+void JSONReader::RequestRouterStats(json::Builder& builder) const {
+    // Счётчики на момент запроса; ответы Route считаются пачкой при первом из них
+    const auto stats = GetRouter().GetTreeCacheStats();
+    builder.Key("tree_cache").StartDict()
+        .Key("hits").Value(static_cast<int>(stats.hits))
+        .Key("misses").Value(static_cast<int>(stats.misses))
+        .Key("evictions").Value(static_cast<int>(stats.evictions))
+        .Key("invalidations").Value(static_cast<int>(stats.invalidations))
+        .Key("cached_trees").Value(static_cast<int>(stats.cached_trees))
+        .Key("memory_used_mb").Value(static_cast<double>(stats.memory_used) / (1024 * 1024))
+        .EndDict();
+}
+
+bool JSONReader::IsUpdateRequest(std::string_view req_type) {
+    return req_type == "SetDistance"sv || req_type == "AddBus"sv || req_type == "RemoveBus"sv;
+}
+
+void JSONReader::RequestUpdate(json::Builder& builder, std::string_view req_type, const json::Dict& req_map) {
+    // Фоновое построение читает справочник: менять его можно только после окончания
+    if (router_build_.valid()) {
+        router_build_.get();
+    }
+    transport::routing::TransportRouter* router = transport_router_ ? &*transport_router_ : nullptr;
+
+    if (req_type == "SetDistance"sv) {
+        const auto* from = catalogue_.FindStop(req_map.at("from"s).AsString());
+        const auto* to = catalogue_.FindStop(req_map.at("to"s).AsString());
+        const int distance = req_map.at("distance"s).AsInt();
+        if (!from || !to) {
+            builder.Key("error_message").Value("not found"s);
+            return;
+        }
+        if (distance < 0) {
+            builder.Key("error_message").Value("invalid distance"s);
+            return;
+        }
+        catalogue_.SetDistance(from, to, distance);
+        if (router) {
+            router->UpdateDistance(from->name, to->name);
+        }
+    } else if (req_type == "AddBus"sv) {
+        AddBus(req_map);
+        if (router) {
+            router->AddBus(req_map.at("name"s).AsString());
         }
-        builder.Key("items").Value(std::move(items));
     } else {
-        builder.Key("error_message").Value("not found"s);
+        const std::string& name = req_map.at("name"s).AsString();
+        if (!catalogue_.RemoveBus(name)) {
+            builder.Key("error_message").Value("not found"s);
+            return;
+        }
+        if (router) {
+            router->RemoveBus(name);
+        }
     }
 }
 
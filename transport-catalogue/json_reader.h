@@ -7,6 +7,7 @@
 #include "json_builder.h"
 #include "transport_router.h"
 
+#include <future>
 #include <istream>
 #include <ostream>
 
@@ -22,6 +23,7 @@ private:
 	void ProcessStops(const json::Array& base_requests);
 	void ProcessDistances(const json::Array& base_requests);
 	void ProcessBusses(const json::Array& base_requests);
+	void AddBus(const json::Dict& req_map);
 
 	void RequestBus(json::Builder& builder, const json::Dict& req_map) const;
 	void RequestStop(json::Builder& builder, const json::Dict& req_map) const;
@@ -29,13 +31,39 @@ private:
 
 	transport::renderer::RenderSettings ReadRenderSettings(const json::Dict& render_settings_map);
 	svg::Color ReadColor(const json::Node& color_node);
+	transport::routing::RoutingSettings ReadRoutingSettings(const json::Dict& routing_settings_map);
 
-	void RequestRoute(json::Builder& builder,
-					 const json::Dict& req_map,
-					 const transport::routing::RoutingSettings& routing_settings) const;
+	// Ответы на запросы Route пакета (по индексу запроса) от begin до первой правки справочника:
+	// один поиск на каждую остановку отправления вместо поиска на каждый запрос
+	std::vector<std::optional<transport::routing::RouteInfo>> BuildRoutesBatch(const json::Array& stat_requests,
+	                                                                           size_t begin) const;
+	void RequestRoute(json::Builder& builder, const std::optional<transport::routing::RouteInfo>& route) const;
+	// Route с "stats": true: ответ дополняется числом вершин, извлечённых поиском
+	static bool HasRouteStats(const json::Dict& req_map);
+	void RequestRouteWithStats(json::Builder& builder, const json::Dict& req_map) const;
+	// Route с "max_transfers": все варианты, где меньше пересадок или быстрее
+	void RequestParetoRoutes(json::Builder& builder, const json::Dict& req_map) const;
+	json::Array MakeRouteItems(const transport::routing::RouteInfo& route) const;
+	// Reachable: остановки, куда можно доехать из "from" не дольше чем за "max_time" минут
+	void RequestReachable(json::Builder& builder, const json::Dict& req_map) const;
+	// Matrix: только время в пути между каждой остановкой "from" и каждой остановкой "to"
+	void RequestMatrix(json::Builder& builder, const json::Dict& req_map) const;
+	// RouterStats: счётчики кэша деревьев кратчайших путей
+	void RequestRouterStats(json::Builder& builder) const;
+	// Правки справочника между запросами: SetDistance, AddBus и RemoveBus. Уже построенный
+	// маршрутизатор обновляется инкрементально, без пересборки
+	static bool IsUpdateRequest(std::string_view req_type);
+	void RequestUpdate(json::Builder& builder, std::string_view req_type, const json::Dict& req_map);
+
+	// Запускает построение маршрутизатора в фоне, пока отвечаем на остальные запросы.
+	// Вызывается до первого запроса, если маршрутизатор понадобится хоть одному из них
+	void StartRouterBuild(const transport::routing::RoutingSettings& routing_settings);
+	// Маршрутизатор; при необходимости дожидается окончания его построения
+	const transport::routing::TransportRouter& GetRouter() const;
 
 private:
 	transport::catalogue::TransportCatalogue& catalogue_;
-	mutable std::optional<transport::routing::TransportRouter> transport_router_;
+	std::optional<transport::routing::TransportRouter> transport_router_;
+	mutable std::future<void> router_build_;
 };
 } // namespace transport::json_reader
\ No newline at end of file
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "flat_array.h"
+#include "graph.h"
+#include "parallel.h"
+#include "serialization.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Ориентиры для A* (ALT). Для нескольких вершин-ориентиров L хранятся веса кратчайших путей
+// L -> v и v -> L до каждой вершины v. По неравенству треугольника d(v, t) >= d(L, t) - d(L, v)
+// и d(v, t) >= d(v, L) - d(t, L); каждая такая оценка согласована, а значит, и их максимум.
+template <typename Weight>
+class Landmarks {
+private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+public:
+    // Выбирает до landmark_count ориентиров среди candidates: каждый следующий — самый далёкий
+    // от уже выбранных. Обратные поиски идут по входящим рёбрам, поэтому граф должен быть заморожен.
+    Landmarks(const Graph& graph, const std::vector<VertexId>& candidates, size_t landmark_count);
+    // Загружает ориентиры, сохранённые Save; таблица не копируется, а ссылается на память файла
+    Landmarks(serialization::Reader& reader, size_t vertex_count);
+
+    void Save(serialization::Writer& writer) const;
+    // Пересчитывает веса путей до тех же ориентиров после изменения графа: заново ищутся только
+    // пути из ориентиров и в ориентиры, которые проходят по рёбрам changed_edges или могут
+    // через них сократиться. Если появились новые вершины, пересчитывается вся таблица.
+    void Update(const Graph& graph, const std::vector<EdgeId>& changed_edges);
+
+    Weight GetLowerBound(VertexId vertex, VertexId target) const;
+
+    size_t GetLandmarkCount() const {
+        return landmarks_.size();
+    }
+
+private:
+    struct Distances {
+        Weight from_landmark;  // путь L -> v
+        Weight to_landmark;    // путь v -> L
+    };
+
+    static constexpr Weight ZERO_WEIGHT{};
+
+    void FillTable(const Graph& graph);
+    // Поиск search: чётные номера — из ориентира search / 2, нечётные — в него
+    void FillSearch(const Graph& graph, size_t search);
+
+    size_t vertex_count_ = 0;
+    std::vector<VertexId> landmarks_;
+    // Ячейка v * landmarks_.size() + i — веса путей между ориентиром i и вершиной v:
+    // все оценки для одной вершины лежат рядом
+    FlatArray<Distances> distances_;
+    // Деревья поисков по номеру поиска: ребро пути, ближайшее к вершине. Нужны только Update,
+    // поэтому не сохраняются; после загрузки из файла первый Update пересчитывает всю таблицу.
+    std::vector<std::vector<EdgeId>> tree_edges_;
+};
+
+template <typename Weight>
+Landmarks<Weight>::Landmarks(const Graph& graph, const std::vector<VertexId>& candidates,
+                             size_t landmark_count)
+    : vertex_count_(graph.GetVertexCount())
+{
+    if (!graph.IsFrozen()) {
+        throw std::logic_error("Landmarks require a frozen graph");
+    }
+    for (const VertexId candidate : candidates) {
+        if (candidate >= vertex_count_) {
+            throw std::out_of_range("Vertex id is out of range");
+        }
+    }
+
+    if (!candidates.empty() && landmark_count > 0) {
+        // Вес пути от ближайшего выбранного ориентира до каждого кандидата. Первый ориентир —
+        // самый далёкий от первого кандидата, поэтому начинаем с весов путей из него.
+        std::vector<Weight> nearest(candidates.size());
+        const auto start_distances = BuildShortestPaths(graph, candidates.front()).weights;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            nearest[i] = start_distances[candidates[i]];
+        }
+        while (landmarks_.size() < landmark_count) {
+            const size_t best = std::max_element(nearest.begin(), nearest.end()) - nearest.begin();
+            // Все кандидаты уже совпадают с ориентирами
+            if (!(ZERO_WEIGHT < nearest[best])) {
+                break;
+            }
+            landmarks_.push_back(candidates[best]);
+            const auto distances = BuildShortestPaths(graph, candidates[best]).weights;
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                nearest[i] = std::min(nearest[i], distances[candidates[i]]);
+            }
+        }
+    }
+    FillTable(graph);
+}
+
+template <typename Weight>
+Landmarks<Weight>::Landmarks(serialization::Reader& reader, size_t vertex_count)
+    : vertex_count_(vertex_count)
+{
+    landmarks_ = reader.ReadVector<VertexId>();
+    if (std::any_of(landmarks_.begin(), landmarks_.end(),
+                    [vertex_count](VertexId landmark) { return landmark >= vertex_count; })) {
+        throw serialization::FormatError("Landmark is out of range");
+    }
+    size_t count = 0;
+    const Distances* data = reader.ReadArray<Distances>(count);
+    if (count != vertex_count_ * landmarks_.size()) {
+        throw serialization::FormatError("Landmark table size mismatch");
+    }
+    // Веса неотрицательны (NaN не проходит сравнение), ориентир находится на нулевом расстоянии от себя
+    const size_t landmark_count = landmarks_.size();
+    for (size_t cell = 0; cell < count; ++cell) {
+        if (!(data[cell].from_landmark >= ZERO_WEIGHT) || !(data[cell].to_landmark >= ZERO_WEIGHT)) {
+            throw serialization::FormatError("Landmark distance is out of range");
+        }
+    }
+    for (size_t i = 0; i < landmark_count; ++i) {
+        const Distances& own = data[landmarks_[i] * landmark_count + i];
+        if (own.from_landmark != ZERO_WEIGHT || own.to_landmark != ZERO_WEIGHT) {
+            throw serialization::FormatError("Landmark distance is out of range");
+        }
+    }
+    distances_.Attach(reader.GetOwner(), data, count);
+}
+
+template <typename Weight>
+void Landmarks<Weight>::Save(serialization::Writer& writer) const {
+    writer.WriteVector(landmarks_);
+    writer.WriteArray(distances_.Data(), distances_.Size());
+}
+
+template <typename Weight>
+void Landmarks<Weight>::Update(const Graph& graph, const std::vector<EdgeId>& changed_edges) {
+    if (!graph.IsFrozen()) {
+        throw std::logic_error("Landmarks require a frozen graph");
+    }
+    const size_t landmark_count = landmarks_.size();
+    if (graph.GetVertexCount() != vertex_count_ || tree_edges_.size() != landmark_count * 2) {
+        vertex_count_ = graph.GetVertexCount();
+        FillTable(graph);
+        return;
+    }
+
+    const Distances* table = distances_.Data();
+    std::vector<char> is_affected(landmark_count * 2, 0);
+    parallel::ForEachIndex(landmark_count * 2, [&](size_t search) {
+        const size_t landmark = search / 2;
+        const bool is_backward = search % 2 == 1;
+        const std::vector<EdgeId>& tree_edges = tree_edges_[search];
+        is_affected[search] = IsAffectedByEdges(
+            graph, changed_edges,
+            [&](VertexId v) {
+                const Distances& cell = table[v * landmark_count + landmark];
+                return is_backward ? cell.to_landmark : cell.from_landmark;
+            },
+            [&tree_edges](VertexId v) { return tree_edges[v]; },
+            is_backward);
+    });
+
+    std::vector<size_t> affected_searches;
+    for (size_t search = 0; search < landmark_count * 2; ++search) {
+        if (is_affected[search]) {
+            affected_searches.push_back(search);
+        }
+    }
+    if (affected_searches.empty()) {
+        return;
+    }
+    // Таблица могла быть отображена из файла: перед правкой копируем её в память
+    distances_.MakeOwned();
+    parallel::ForEachIndex(affected_searches.size(), [&](size_t index) {
+        FillSearch(graph, affected_searches[index]);
+    });
+}
+
+template <typename Weight>
+void Landmarks<Weight>::FillTable(const Graph& graph) {
+    const size_t landmark_count = landmarks_.size();
+    distances_.Assign(vertex_count_ * landmark_count, Distances{UNREACHABLE<Weight>, UNREACHABLE<Weight>});
+    tree_edges_.assign(landmark_count * 2, {});
+    // Поиски независимы и пишут в разные ячейки таблицы
+    parallel::ForEachIndex(landmark_count * 2, [&](size_t search) {
+        FillSearch(graph, search);
+    });
+}
+
+template <typename Weight>
+void Landmarks<Weight>::FillSearch(const Graph& graph, size_t search) {
+    const size_t landmark_count = landmarks_.size();
+    const size_t landmark = search / 2;
+    const bool is_backward = search % 2 == 1;
+    ShortestPaths<Weight> paths = BuildShortestPaths(graph, landmarks_[landmark], is_backward);
+    Distances* table = distances_.MutableData();
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        Distances& cell = table[vertex * landmark_count + landmark];
+        (is_backward ? cell.to_landmark : cell.from_landmark) = paths.weights[vertex];
+    }
+    tree_edges_[search] = std::move(paths.prev_edges);
+}
+
+template <typename Weight>
+Weight Landmarks<Weight>::GetLowerBound(VertexId vertex, VertexId target) const {
+    const size_t landmark_count = landmarks_.size();
+    const Distances* from = distances_.Data() + vertex * landmark_count;
+    const Distances* to = distances_.Data() + target * landmark_count;
+    Weight bound = ZERO_WEIGHT;
+    for (size_t i = 0; i < landmark_count; ++i) {
+        // Оценка через ориентир, от которого или до которого нет пути, ничего не даёт
+        if (from[i].from_landmark != UNREACHABLE<Weight> && to[i].from_landmark != UNREACHABLE<Weight>
+            && from[i].from_landmark < to[i].from_landmark) {
+            bound = std::max(bound, to[i].from_landmark - from[i].from_landmark);
+        }
+        if (from[i].to_landmark != UNREACHABLE<Weight> && to[i].to_landmark != UNREACHABLE<Weight>
+            && to[i].to_landmark < from[i].to_landmark) {
+            bound = std::max(bound, from[i].to_landmark - to[i].to_landmark);
+        }
+    }
+    return bound;
+}
+
+}  // namespace graph
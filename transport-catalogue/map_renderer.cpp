@@ -17,14 +17,15 @@ MapRenderer::MapRenderer(const RenderSettings& settings, const transport::catalo
 svg::Document MapRenderer::Render() const {
     svg::Document doc;
     
-    auto stops_coords = GetAllStopCoordinates();
+    const auto stop_ids = GetSortedStopIds();
+    const auto stops_coords = GetStopCoordinates(stop_ids);
     SphereProjector projector(stops_coords.begin(), stops_coords.end(),
                              settings_.width, settings_.height, settings_.padding);
     
     RenderBusLines(doc, projector);
     RenderBusLabels(doc, projector);
-    RenderStopPoints(doc, projector);
-    RenderStopLabels(doc, projector);
+    RenderStopPoints(doc, projector, stops_coords);
+    RenderStopLabels(doc, projector, stop_ids, stops_coords);
     
     return doc;
 }
@@ -64,7 +65,7 @@ void MapRenderer::RenderBusLabels(svg::Document& doc, const SphereProjector& pro
         const auto* bus = buses[i];
         if (bus->stops.empty()) continue;
         
-        auto add_bus_label = [&](const domain::Stop* stop, const std::string& bus_name) {
+        auto add_bus_label = [&](const domain::Stop* stop, std::string_view bus_name) {
             // Подложка
             svg::Text underlayer;
             underlayer.SetPosition(projector(stop->coordinates))
@@ -72,7 +73,7 @@ void MapRenderer::RenderBusLabels(svg::Document& doc, const SphereProjector& pro
                      .SetFontSize(settings_.bus_label_font_size)
                      .SetFontFamily("Verdana"s)
                      .SetFontWeight("bold"s)
-                     .SetData(bus_name)
+                     .SetData(std::string(bus_name))
                      .SetFillColor(settings_.underlayer_color)
                      .SetStrokeColor(settings_.underlayer_color)
                      .SetStrokeWidth(settings_.underlayer_width)
@@ -86,7 +87,7 @@ void MapRenderer::RenderBusLabels(svg::Document& doc, const SphereProjector& pro
                 .SetFontSize(settings_.bus_label_font_size)
                 .SetFontFamily("Verdana"s)
                 .SetFontWeight("bold"s)
-                .SetData(bus_name)
+                .SetData(std::string(bus_name))
                 .SetFillColor(settings_.color_palette[i % settings_.color_palette.size()]);
             
             doc.Add(std::move(underlayer));
@@ -101,17 +102,11 @@ void MapRenderer::RenderBusLabels(svg::Document& doc, const SphereProjector& pro
     }
 }
 
-void MapRenderer::RenderStopPoints(svg::Document& doc, const SphereProjector& projector) const {
-    auto used_stops = catalogue_.GetStopsUsedInRoutes();
-    
-    std::sort(used_stops.begin(), used_stops.end(),
-              [](const domain::Stop* lhs, const domain::Stop* rhs) {
-                  return lhs->name < rhs->name;
-              });
-    
-    for (const auto* stop : used_stops) {
+void MapRenderer::RenderStopPoints(svg::Document& doc, const SphereProjector& projector,
+                                   const std::vector<geo::Coordinates>& stops_coords) const {
+    for (const auto& coords : stops_coords) {
         svg::Circle circle;
-        circle.SetCenter(projector(stop->coordinates))
+        circle.SetCenter(projector(coords))
               .SetRadius(settings_.stop_radius)
               .SetFillColor("white"s);
         
@@ -119,22 +114,20 @@ void MapRenderer::RenderStopPoints(svg::Document& doc, const SphereProjector& pr
     }
 }
 
-void MapRenderer::RenderStopLabels(svg::Document& doc, const SphereProjector& projector) const {
-    auto used_stops = catalogue_.GetStopsUsedInRoutes();
-    
-    std::sort(used_stops.begin(), used_stops.end(),
-              [](const domain::Stop* lhs, const domain::Stop* rhs) {
-                  return lhs->name < rhs->name;
-              });
-    
-    for (const auto* stop : used_stops) {
+void MapRenderer::RenderStopLabels(svg::Document& doc, const SphereProjector& projector,
+                                   const std::vector<uint32_t>& stop_ids,
+                                   const std::vector<geo::Coordinates>& stops_coords) const {
+    for (size_t i = 0; i < stop_ids.size(); ++i) {
+        const std::string name(catalogue_.GetStopName(stop_ids[i]));
+        const svg::Point position = projector(stops_coords[i]);
+
         // Подложка
         svg::Text underlayer;
-        underlayer.SetPosition(projector(stop->coordinates))
+        underlayer.SetPosition(position)
                  .SetOffset(settings_.stop_label_offset)
                  .SetFontSize(settings_.stop_label_font_size)
                  .SetFontFamily("Verdana"s)
-                 .SetData(stop->name)
+                 .SetData(name)
                  .SetFillColor(settings_.underlayer_color)
                  .SetStrokeColor(settings_.underlayer_color)
                  .SetStrokeWidth(settings_.underlayer_width)
@@ -143,11 +136,11 @@ void MapRenderer::RenderStopLabels(svg::Document& doc, const SphereProjector& pr
         
         // Основной текст
         svg::Text text;
-        text.SetPosition(projector(stop->coordinates))
+        text.SetPosition(position)
             .SetOffset(settings_.stop_label_offset)
             .SetFontSize(settings_.stop_label_font_size)
             .SetFontFamily("Verdana"s)
-            .SetData(stop->name)
+            .SetData(name)
             .SetFillColor("black"s);
         
         doc.Add(std::move(underlayer));
@@ -173,14 +166,22 @@ std::vector<const domain::Bus*> MapRenderer::GetSortedBuses() const {
     return buses_with_stops;
 }
 
-std::vector<geo::Coordinates> MapRenderer::GetAllStopCoordinates() const {
-    auto used_stops = catalogue_.GetStopsUsedInRoutes();
+std::vector<uint32_t> MapRenderer::GetSortedStopIds() const {
+    auto stop_ids = catalogue_.GetStopIdsUsedInRoutes();
+    std::sort(stop_ids.begin(), stop_ids.end(), [this](uint32_t lhs, uint32_t rhs) {
+        return catalogue_.GetStopName(lhs) < catalogue_.GetStopName(rhs);
+    });
+    return stop_ids;
+}
+
+std::vector<geo::Coordinates> MapRenderer::GetStopCoordinates(const std::vector<uint32_t>& stop_ids) const {
+    const auto& lats = catalogue_.GetStopLatitudes();
+    const auto& lngs = catalogue_.GetStopLongitudes();
     std::vector<geo::Coordinates> coords;
-    
-    for (const auto* stop : used_stops) {
-        coords.push_back(stop->coordinates);
+    coords.reserve(stop_ids.size());
+    for (const uint32_t stop_id : stop_ids) {
+        coords.push_back({lats[stop_id], lngs[stop_id]});
     }
-    
     return coords;
 }
 
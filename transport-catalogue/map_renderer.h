@@ -5,6 +5,7 @@
 #include "domain.h"
 #include "transport_catalogue.h"
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -102,11 +103,17 @@ private:
     
     void RenderBusLines(svg::Document& doc, const SphereProjector& projector) const;
     void RenderBusLabels(svg::Document& doc, const SphereProjector& projector) const;
-    void RenderStopPoints(svg::Document& doc, const SphereProjector& projector) const;
-    void RenderStopLabels(svg::Document& doc, const SphereProjector& projector) const;
+    // Слои остановок идут по столбцам справочника: stops_coords[i] — координаты stop_ids[i]
+    void RenderStopPoints(svg::Document& doc, const SphereProjector& projector,
+                          const std::vector<geo::Coordinates>& stops_coords) const;
+    void RenderStopLabels(svg::Document& doc, const SphereProjector& projector,
+                          const std::vector<uint32_t>& stop_ids,
+                          const std::vector<geo::Coordinates>& stops_coords) const;
     
     std::vector<const domain::Bus*> GetSortedBuses() const;
-    std::vector<geo::Coordinates> GetAllStopCoordinates() const;
+    // Номера остановок с автобусами по возрастанию имён
+    std::vector<uint32_t> GetSortedStopIds() const;
+    std::vector<geo::Coordinates> GetStopCoordinates(const std::vector<uint32_t>& stop_ids) const;
 };
 
 } // namespace transport::renderer
\ No newline at end of file
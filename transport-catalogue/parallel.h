@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+inline size_t GetDefaultThreadCount() {
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Постоянные рабочие потоки: создаются один раз и ждут задач, поэтому частые короткие
+// ForEachIndex (например, фазы блочного Флойда–Уоршелла) не платят за создание потоков.
+// Вызывающий поток тоже берёт индексы. ForEachIndex можно звать из нескольких потоков сразу;
+// вложенный вызов из рабочего потока выполняется в нём же последовательно.
+class ThreadPool {
+public:
+    // worker_count рабочих потоков в дополнение к вызывающему
+    explicit ThreadPool(size_t worker_count) {
+        workers_.reserve(worker_count);
+        for (size_t i = 0; i < worker_count; ++i) {
+            workers_.emplace_back([this] {
+                WorkerLoop();
+            });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard guard(mutex_);
+            is_stopped_ = true;
+        }
+        work_available_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // Общий пул процесса: GetDefaultThreadCount() потоков вместе с вызывающим
+    static ThreadPool& GetDefault() {
+        static ThreadPool pool(GetDefaultThreadCount() - 1);
+        return pool;
+    }
+
+    // Вызывает func(index) для каждого index из [0, count), раздавая индексы не более чем
+    // thread_count потокам по одному. Первое выброшенное исключение пробрасывается после того,
+    // как все потоки закончат работу над этим вызовом.
+    template <typename Func>
+    void ForEachIndex(size_t count, Func&& func, size_t thread_count) {
+        thread_count = std::min({thread_count, count, workers_.size() + 1});
+        if (thread_count <= 1 || is_worker_thread_) {
+            for (size_t index = 0; index < count; ++index) {
+                func(index);
+            }
+            return;
+        }
+
+        auto call = [&func](size_t index) {
+            func(index);
+        };
+        Job job(count, call);
+        {
+            std::lock_guard guard(mutex_);
+            for (size_t i = 1; i < thread_count; ++i) {
+                jobs_.push_back(&job);
+            }
+        }
+        work_available_.notify_all();
+        job.Run();
+        {
+            std::unique_lock lock(mutex_);
+            // Индексы кончились: ещё не взятые места в задаче больше не нужны
+            jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), &job), jobs_.end());
+            job_finished_.wait(lock, [&job] {
+                return job.helper_count == 0;
+            });
+        }
+        if (job.error) {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+private:
+    // Один вызов ForEachIndex; живёт на стеке вызывающего потока, пока тот не дождётся помощников
+    struct Job {
+        template <typename Call>
+        Job(size_t count, Call& call)
+            : count(count)
+            , context(&call)
+            , invoke([](void* context, size_t index) {
+                (*static_cast<Call*>(context))(index);
+            }) {
+        }
+
+        void Run() {
+            for (size_t index = next_index++; index < count; index = next_index++) {
+                try {
+                    invoke(context, index);
+                } catch (...) {
+                    std::lock_guard guard(error_mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        }
+
+        const size_t count;
+        std::atomic<size_t> next_index{0};
+        void* const context;
+        void (*const invoke)(void* context, size_t index);
+        size_t helper_count = 0;  // рабочие потоки внутри Run; под mutex_ пула
+        std::exception_ptr error;
+        std::mutex error_mutex;
+    };
+
+    void WorkerLoop() {
+        is_worker_thread_ = true;
+        std::unique_lock lock(mutex_);
+        while (true) {
+            work_available_.wait(lock, [this] {
+                return is_stopped_ || !jobs_.empty();
+            });
+            if (jobs_.empty()) {
+                return;
+            }
+            Job* job = jobs_.front();
+            jobs_.pop_front();
+            ++job->helper_count;
+            lock.unlock();
+            job->Run();
+            lock.lock();
+            if (--job->helper_count == 0) {
+                job_finished_.notify_all();
+            }
+        }
+    }
+
+    inline static thread_local bool is_worker_thread_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable job_finished_;
+    // По месту на каждый рабочий поток, который может помочь задаче
+    std::deque<Job*> jobs_;
+    bool is_stopped_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// Вызывает func(index) для каждого index из [0, count) в общем пуле потоков,
+// раздавая индексы потокам по одному. Первое выброшенное исключение пробрасывается
+// после завершения всех потоков.
+template <typename Func>
+void ForEachIndex(size_t count, Func&& func, size_t thread_count = GetDefaultThreadCount()) {
+    ThreadPool::GetDefault().ForEachIndex(count, func, thread_count);
+}
+
+}  // namespace parallel
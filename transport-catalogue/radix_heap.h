@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace graph {
+
+// Радикс-куча для неотрицательных целых ключей, которые не убывают: ключ каждой новой
+// записи не меньше последнего извлечённого (так ведут себя ключи Дейкстры). Записи лежат
+// в корзинах по старшему биту, которым ключ отличается от последнего извлечённого, поэтому
+// каждая запись перекладывается не более чем разрядность ключа раз и сравнения не нужны.
+// Интерфейс повторяет std::priority_queue с std::greater: top() — запись с наименьшим ключом.
+template <typename Weight, typename Value>
+class RadixHeap {
+    static_assert(std::is_integral_v<Weight>, "Radix heap needs integral keys");
+
+public:
+    using Item = std::pair<Weight, Value>;
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    void push(const Item& item) {
+        if (item.first < last_key_) {
+            throw std::logic_error("Radix heap keys must not decrease");
+        }
+        buckets_[GetBucketIndex(item.first)].push_back(item);
+        ++size_;
+    }
+
+    const Item& top() const {
+        Refill();
+        return buckets_[0].back();
+    }
+
+    void pop() {
+        Refill();
+        buckets_[0].pop_back();
+        --size_;
+    }
+
+private:
+    using Key = std::make_unsigned_t<Weight>;
+    static constexpr size_t BUCKET_COUNT = std::numeric_limits<Key>::digits + 1;
+
+    static size_t GetBitWidth(Key value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return value == 0 ? 0 : std::numeric_limits<unsigned long long>::digits
+                                    - __builtin_clzll(static_cast<unsigned long long>(value));
+#else
+        size_t width = 0;
+        for (; value != 0; value >>= 1) {
+            ++width;
+        }
+        return width;
+#endif
+    }
+
+    size_t GetBucketIndex(Weight key) const {
+        return GetBitWidth(static_cast<Key>(key) ^ static_cast<Key>(last_key_));
+    }
+
+    // Корзина 0 хранит записи с ключом last_key_. Когда она пуста, last_key_ сдвигается
+    // на наименьший ключ первой непустой корзины, и та раскладывается по младшим корзинам.
+    void Refill() const {
+        if (!buckets_[0].empty()) {
+            return;
+        }
+        if (size_ == 0) {
+            throw std::logic_error("Radix heap is empty");
+        }
+        size_t index = 1;
+        while (buckets_[index].empty()) {
+            ++index;
+        }
+        auto& bucket = buckets_[index];
+        last_key_ = bucket.front().first;
+        for (const Item& item : bucket) {
+            last_key_ = std::min(last_key_, item.first);
+        }
+        for (const Item& item : bucket) {
+            buckets_[GetBucketIndex(item.first)].push_back(item);
+        }
+        bucket.clear();
+    }
+
+    // Перекладывание при top() не меняет содержимого кучи
+    mutable std::array<std::vector<Item>, BUCKET_COUNT> buckets_;
+    mutable Weight last_key_{};
+    size_t size_ = 0;
+};
+
+}  // namespace graph
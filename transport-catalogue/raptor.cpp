@@ -0,0 +1,275 @@
+#include "raptor.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace transport::routing {
+
+namespace {
+    constexpr uint32_t kNoPosition = std::numeric_limits<uint32_t>::max();
+    constexpr double kUnreachable = std::numeric_limits<double>::infinity();
+}
+
+RaptorRouter::RaptorRouter(
+    const catalogue::TransportCatalogue& catalogue,
+    const std::vector<const domain::Stop*>& stops,
+    const std::vector<uint32_t>& stop_indices,
+    double wait_time, double bus_velocity)
+    : stop_count_(stops.size())
+    , wait_time_(wait_time)
+    , meters_per_minute_((bus_velocity * 1000.0) / 60.0)
+{
+    // Некольцевой маршрут даёт два независимых прохода: проехать через конечную нельзя
+    for (const auto* bus : catalogue.GetAllBuses()) {
+        const auto& stops = bus->stops;
+        const size_t n = stops.size();
+        if (n < 2) continue;
+        const auto& distances = catalogue.GetBusDistances(bus);
+
+        pattern_buses_.push_back(bus);
+        pattern_offsets_.push_back(static_cast<uint32_t>(pattern_stops_.size()));
+        for (size_t i = 0; i < n; ++i) {
+            pattern_stops_.push_back(stop_indices.at(stops[i]->id));
+            pattern_distances_.push_back(distances.forward_road[i]);
+        }
+        if (!bus->is_circle) {
+            pattern_buses_.push_back(bus);
+            pattern_offsets_.push_back(static_cast<uint32_t>(pattern_stops_.size()));
+            for (size_t i = n; i-- > 0;) {
+                pattern_stops_.push_back(stop_indices.at(stops[i]->id));
+                pattern_distances_.push_back(distances.backward_road[n - 1] - distances.backward_road[i]);
+            }
+        }
+    }
+    pattern_offsets_.push_back(static_cast<uint32_t>(pattern_stops_.size()));
+
+    stop_offsets_.assign(stop_count_ + 1, 0);
+    for (const uint32_t stop : pattern_stops_) {
+        ++stop_offsets_[stop + 1];
+    }
+    for (size_t stop = 0; stop < stop_count_; ++stop) {
+        stop_offsets_[stop + 1] += stop_offsets_[stop];
+    }
+    stop_patterns_.resize(pattern_stops_.size());
+    std::vector<uint32_t> positions(stop_offsets_.begin(), stop_offsets_.end() - 1);
+    for (uint32_t pattern = 0; pattern + 1 < pattern_offsets_.size(); ++pattern) {
+        for (uint32_t i = pattern_offsets_[pattern]; i < pattern_offsets_[pattern + 1]; ++i) {
+            stop_patterns_[positions[pattern_stops_[i]]++] = {pattern, i - pattern_offsets_[pattern]};
+        }
+    }
+}
+
+double RaptorRouter::ComputeRideTime(uint32_t pattern, uint32_t board_position, uint32_t alight_position) const {
+    const uint32_t begin = pattern_offsets_[pattern];
+    const int64_t distance = pattern_distances_[begin + alight_position] - pattern_distances_[begin + board_position];
+    return distance / meters_per_minute_;
+}
+
+std::vector<RaptorRouter::Journey> RaptorRouter::FindJourneys(size_t from, size_t to, size_t max_transfers) const {
+    if (from == to) {
+        return {Journey{}};
+    }
+    return Search(from, to, max_transfers + 1, true);
+}
+
+std::optional<RaptorRouter::Journey> RaptorRouter::FindFastestJourney(size_t from, size_t to) const {
+    if (from == to) {
+        return Journey{};
+    }
+    // Больше поездок, чем остановок, в кратчайшем маршруте не бывает
+    auto journeys = Search(from, to, stop_count_, false);
+    if (journeys.empty()) {
+        return std::nullopt;
+    }
+    return std::move(journeys.back());
+}
+
+std::vector<std::pair<size_t, double>> RaptorRouter::FindReachable(size_t from, double max_time) const {
+    std::vector<std::pair<size_t, double>> reachable;
+    if (max_time < 0.0) {
+        return reachable;
+    }
+
+    // Число пересадок не важно, поэтому раунды делят одну метку на остановку
+    // и повторяются, пока какое-то время прибытия улучшается
+    std::vector<double> arrivals(stop_count_, kUnreachable);
+    arrivals[from] = 0.0;
+    std::vector<uint32_t> marked_stops{static_cast<uint32_t>(from)};
+    std::vector<char> is_marked(stop_count_, 0);
+    is_marked[from] = 1;
+    std::vector<uint32_t> first_position(pattern_buses_.size(), kNoPosition);
+    std::vector<uint32_t> patterns_to_scan;
+
+    while (!marked_stops.empty()) {
+        for (const uint32_t stop : marked_stops) {
+            is_marked[stop] = 0;
+            // С остановки, куда приехали уже без запаса на ожидание, уехать некуда
+            if (arrivals[stop] + wait_time_ > max_time) {
+                continue;
+            }
+            for (uint32_t i = stop_offsets_[stop]; i < stop_offsets_[stop + 1]; ++i) {
+                const auto [pattern, position] = stop_patterns_[i];
+                if (first_position[pattern] == kNoPosition) {
+                    patterns_to_scan.push_back(pattern);
+                }
+                first_position[pattern] = std::min(first_position[pattern], position);
+            }
+        }
+        marked_stops.clear();
+
+        for (const uint32_t pattern : patterns_to_scan) {
+            const uint32_t begin = pattern_offsets_[pattern];
+            const uint32_t length = pattern_offsets_[pattern + 1] - begin;
+            bool boarded = false;
+            uint32_t board_position = 0;
+            double board_time = 0.0;
+
+            for (uint32_t position = first_position[pattern]; position < length; ++position) {
+                const uint32_t stop = pattern_stops_[begin + position];
+                const double ride_arrival = boarded
+                    ? board_time + ComputeRideTime(pattern, board_position, position)
+                    : kUnreachable;
+                if (ride_arrival <= max_time && ride_arrival < arrivals[stop]) {
+                    arrivals[stop] = ride_arrival;
+                    if (!is_marked[stop]) {
+                        is_marked[stop] = 1;
+                        marked_stops.push_back(stop);
+                    }
+                }
+                if (arrivals[stop] + wait_time_ < ride_arrival) {
+                    boarded = true;
+                    board_position = position;
+                    board_time = arrivals[stop] + wait_time_;
+                }
+            }
+            first_position[pattern] = kNoPosition;
+        }
+        patterns_to_scan.clear();
+    }
+
+    for (size_t stop = 0; stop < stop_count_; ++stop) {
+        if (arrivals[stop] <= max_time) {
+            reachable.emplace_back(stop, arrivals[stop]);
+        }
+    }
+    std::sort(reachable.begin(), reachable.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second < rhs.second;
+    });
+    return reachable;
+}
+
+std::vector<RaptorRouter::Journey> RaptorRouter::Search(size_t from, size_t to, size_t max_rounds, bool pareto) const {
+    const size_t pattern_count = pattern_buses_.size();
+
+    // arrivals[k][s] — лучшее время прибытия на s не более чем за k поездок
+    std::vector<std::vector<double>> arrivals(1, std::vector<double>(stop_count_, kUnreachable));
+    std::vector<std::vector<Parent>> parents(1);
+    std::vector<double> best(stop_count_, kUnreachable);
+    arrivals[0][from] = 0.0;
+    best[from] = 0.0;
+
+    std::vector<uint32_t> marked_stops{static_cast<uint32_t>(from)};
+    std::vector<char> is_marked(stop_count_, 0);
+    is_marked[from] = 1;
+    // Самая ранняя отмеченная позиция каждого прохода, с которой его нужно просмотреть
+    std::vector<uint32_t> first_position(pattern_count, kNoPosition);
+    std::vector<uint32_t> patterns_to_scan;
+    // Раунды, в которых улучшилось время прибытия в цель
+    std::vector<size_t> improving_rounds;
+
+    for (size_t round = 1; round <= max_rounds && !marked_stops.empty(); ++round) {
+        for (const uint32_t stop : marked_stops) {
+            is_marked[stop] = 0;
+            for (uint32_t i = stop_offsets_[stop]; i < stop_offsets_[stop + 1]; ++i) {
+                const auto [pattern, position] = stop_patterns_[i];
+                if (first_position[pattern] == kNoPosition) {
+                    patterns_to_scan.push_back(pattern);
+                }
+                first_position[pattern] = std::min(first_position[pattern], position);
+            }
+        }
+        marked_stops.clear();
+
+        arrivals.push_back(arrivals.back());
+        parents.emplace_back(stop_count_);
+        const auto& previous = arrivals[round - 1];
+        auto& current = arrivals[round];
+        auto& round_parents = parents[round];
+
+        for (const uint32_t pattern : patterns_to_scan) {
+            const uint32_t begin = pattern_offsets_[pattern];
+            const uint32_t length = pattern_offsets_[pattern + 1] - begin;
+            bool boarded = false;
+            uint32_t board_position = 0;
+            double board_time = 0.0;  // с учётом ожидания
+
+            for (uint32_t position = first_position[pattern]; position < length; ++position) {
+                const uint32_t stop = pattern_stops_[begin + position];
+                const double ride_arrival = boarded
+                    ? board_time + ComputeRideTime(pattern, board_position, position)
+                    : kUnreachable;
+                if (ride_arrival < best[stop] && ride_arrival < best[to]) {
+                    current[stop] = ride_arrival;
+                    best[stop] = ride_arrival;
+                    round_parents[stop] = {pattern, board_position, position};
+                    if (!is_marked[stop]) {
+                        is_marked[stop] = 1;
+                        marked_stops.push_back(stop);
+                    }
+                }
+                // Пересесть здесь на этот же маршрут выгоднее, чем ехать дальше
+                if (previous[stop] + wait_time_ < ride_arrival) {
+                    boarded = true;
+                    board_position = position;
+                    board_time = previous[stop] + wait_time_;
+                }
+            }
+            first_position[pattern] = kNoPosition;
+        }
+        patterns_to_scan.clear();
+
+        if (current[to] < previous[to]) {
+            improving_rounds.push_back(round);
+        }
+    }
+
+    auto reconstruct = [&](size_t round) {
+        Journey journey;
+        journey.total_time = arrivals[round][to];
+        size_t stop = to;
+        while (true) {
+            // Метка могла перейти из более раннего раунда без изменений
+            while (round > 0 && arrivals[round - 1][stop] == arrivals[round][stop]) {
+                --round;
+            }
+            if (round == 0) {
+                break;
+            }
+            const Parent& parent = parents[round][stop];
+            const size_t board_stop = pattern_stops_[pattern_offsets_[parent.pattern] + parent.board_position];
+            journey.legs.push_back({
+                board_stop,
+                pattern_buses_[parent.pattern],
+                parent.alight_position - parent.board_position,
+                ComputeRideTime(parent.pattern, parent.board_position, parent.alight_position)
+            });
+            stop = board_stop;
+            --round;
+        }
+        std::reverse(journey.legs.begin(), journey.legs.end());
+        journey.transfers = journey.legs.empty() ? 0 : journey.legs.size() - 1;
+        return journey;
+    };
+
+    std::vector<Journey> journeys;
+    if (pareto) {
+        for (const size_t round : improving_rounds) {
+            journeys.push_back(reconstruct(round));
+        }
+    } else if (!improving_rounds.empty()) {
+        journeys.push_back(reconstruct(improving_rounds.back()));
+    }
+    return journeys;
+}
+
+} // namespace transport::routing
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "transport_catalogue.h"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace transport::routing {
+
+// Поиск по раундам в духе RAPTOR: раунд k находит лучшие времена прибытия не более чем
+// с k поездками, просматривая маршруты как плоские последовательности остановок.
+// Граф рёбер не строится. Автобусы ходят без расписания, каждая посадка стоит wait_time.
+class RaptorRouter {
+public:
+    struct Leg {
+        size_t board_stop;            // индекс остановки посадки
+        const domain::Bus* bus;
+        size_t span_count;
+        double time;                  // в минутах, без ожидания
+    };
+
+    struct Journey {
+        double total_time = 0.0;
+        size_t transfers = 0;
+        std::vector<Leg> legs;
+    };
+
+    // stops задаёт нумерацию остановок, stop_indices — номер остановки по её номеру в справочнике
+    RaptorRouter(const catalogue::TransportCatalogue& catalogue,
+                 const std::vector<const domain::Stop*>& stops,
+                 const std::vector<uint32_t>& stop_indices,
+                 double wait_time, double bus_velocity);
+
+    // Парето-оптимальные по (времени, пересадкам) поездки не более чем с max_transfers
+    // пересадками, по возрастанию числа пересадок. Пусто, если остановка недостижима.
+    std::vector<Journey> FindJourneys(size_t from, size_t to, size_t max_transfers) const;
+    // Самая быстрая поездка без ограничения на пересадки
+    std::optional<Journey> FindFastestJourney(size_t from, size_t to) const;
+    // Остановки, куда можно доехать из from не дольше чем за max_time минут, со временем
+    // в пути, по возрастанию времени
+    std::vector<std::pair<size_t, double>> FindReachable(size_t from, double max_time) const;
+
+private:
+    // Элемент обратного индекса: маршрут, проходящий через остановку, и позиция в нём
+    struct StopPattern {
+        uint32_t pattern;
+        uint32_t position;
+    };
+
+    // Откуда пришла метка раунда: маршрут и позиции посадки и высадки
+    struct Parent {
+        uint32_t pattern;
+        uint32_t board_position;
+        uint32_t alight_position;
+    };
+
+    size_t stop_count_ = 0;
+    double wait_time_ = 0.0;
+    double meters_per_minute_ = 0.0;
+
+    // Проходы автобусов в одном направлении: остановки прохода p лежат
+    // в [pattern_offsets_[p], pattern_offsets_[p + 1])
+    std::vector<const domain::Bus*> pattern_buses_;
+    std::vector<uint32_t> pattern_offsets_;
+    std::vector<uint32_t> pattern_stops_;
+    // Расстояние от начала прохода до каждой его остановки, в метрах
+    std::vector<int64_t> pattern_distances_;
+    // Обратный индекс в CSR: проходы остановки s лежат в [stop_offsets_[s], stop_offsets_[s + 1])
+    std::vector<uint32_t> stop_offsets_;
+    std::vector<StopPattern> stop_patterns_;
+
+    double ComputeRideTime(uint32_t pattern, uint32_t board_position, uint32_t alight_position) const;
+    std::vector<Journey> Search(size_t from, size_t to, size_t max_rounds, bool pareto) const;
+};
+
+} // namespace transport::routing
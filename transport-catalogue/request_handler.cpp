@@ -6,7 +6,7 @@ std::optional<transport::catalogue::BusInfo> GetBusStat(std::string_view bus_nam
     return catalogue.GetBusInfo(bus_name);
 }
 
-std::optional<const std::set<std::string>*> GetBusesByStop(std::string_view stop_name, const transport::catalogue::TransportCatalogue& catalogue) {
+std::optional<transport::catalogue::BusIdRange> GetBusesByStop(std::string_view stop_name, const transport::catalogue::TransportCatalogue& catalogue) {
     return catalogue.GetBusesByStop(stop_name);
 }
 
@@ -1,117 +1,926 @@
 #pragma once
 
+#include "contraction_hierarchy.h"
+#include "flat_array.h"
 #include "graph.h"
+#include "landmarks.h"
+#include "parallel.h"
+#include "serialization.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <queue>
 #include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace graph {
 
+enum class RouterMode {
+    ALL_PAIRS,  // таблица всех пар (Флойд–Уоршелл) в конструкторе, O(V²) памяти
+    ON_DEMAND,  // Дейкстра на каждый запрос, без предподсчёта
+    CONTRACTION_HIERARCHIES,  // предподсчёт сокращений, двунаправленный поиск вверх по иерархии
+    A_STAR,     // A* с нижней оценкой расстояния до цели: SetPotential и/или ориентиры ALT
+    BIDIRECTIONAL,  // Дейкстра одновременно от начала и от конца; нужен замороженный граф
+    ALL_PAIRS_COMPACT,  // таблица всех пар по 8 байт на ячейку: вес float и 32-битное ребро
+};
+
+// Счётчики кэша деревьев кратчайших путей (режим ON_DEMAND)
+struct TreeCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t invalidations = 0;  // деревья, сброшенные из-за изменения графа
+    size_t cached_trees = 0;
+    size_t memory_used = 0;    // в байтах
+};
+
 template <typename Weight>
 class Router {
 private:
     using Graph = DirectedWeightedGraph<Weight>;
 
 public:
-    explicit Router(const Graph& graph);
+    explicit Router(const Graph& graph, RouterMode mode = RouterMode::ALL_PAIRS);
+    // Восстанавливает предподсчитанное состояние, записанное SaveState, вместо его построения.
+    // Таблицы всех пар не копируются, а ссылаются на память файла.
+    Router(const Graph& graph, RouterMode mode, serialization::Reader& reader);
 
     struct RouteInfo {
         Weight weight;
         std::vector<EdgeId> edges;
+        size_t settled_vertices = 0;    // сколько вершин извлёк поиск (0 для готовой таблицы или дерева из кэша)
     };
 
+    // Нижняя оценка веса пути от vertex до target. Для корректности A* оценка должна быть
+    // согласованной: potential(u) <= weight(u, v) + potential(v) для каждого ребра.
+    using Potential = std::function<Weight(VertexId vertex, VertexId target)>;
+
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    // Маршруты из одной вершины сразу в несколько: в режимах с поиском по запросу строится
+    // одно дерево на все цели вместо поиска на каждую
+    std::vector<std::optional<RouteInfo>> BuildRoutes(VertexId from,
+                                                      const std::vector<VertexId>& targets) const;
+    // Вершины, до которых есть путь из from весом не больше max_weight, с весами путей,
+    // по возрастанию веса. Поиск останавливается, как только вес превысит max_weight.
+    std::vector<std::pair<VertexId, Weight>> FindReachable(VertexId from, Weight max_weight) const;
+    // Только веса путей из каждой вершины sources в каждую вершину targets, без рёбер:
+    // ячейка i * targets.size() + j — путь sources[i] -> targets[j], nullopt, если его нет
+    std::vector<std::optional<Weight>> BuildWeightMatrix(const std::vector<VertexId>& sources,
+                                                         const std::vector<VertexId>& targets) const;
+
+    void SaveState(serialization::Writer& writer) const;
+
+    // Сообщает об изменении графа: у рёбер changed_edges новый вес, они добавлены или удалены,
+    // могли появиться и новые вершины. Пересчитываются только строки таблиц и кэшированные
+    // деревья, путь в которых проходит по изменённому ребру или может через него сократиться;
+    // иерархия сокращений строится заново.
+    void UpdateEdges(const std::vector<EdgeId>& changed_edges);
+
+    RouterMode GetMode() const {
+        return mode_;
+    }
+
+    // Бюджет памяти (в байтах) на кэш деревьев из часто встречающихся исходных вершин.
+    // Используется только в режиме ON_DEMAND; 0 отключает кэш.
+    void SetTreeCacheBudget(size_t budget_bytes);
+    void SetPotential(Potential potential);
+    // Ориентиры ALT для режима A_STAR, до landmark_count штук среди candidates. Их оценка
+    // объединяется с заданной SetPotential через максимум, сохраняется в SaveState
+    // и пересчитывается в UpdateEdges. Нужен замороженный граф.
+    void BuildLandmarks(const std::vector<VertexId>& candidates, size_t landmark_count);
+    TreeCacheStats GetTreeCacheStats() const;
 
 private:
-    struct RouteInternalData {
-        Weight weight;
-        std::optional<EdgeId> prev_edge;
+    // Дерево кратчайших путей из одной вершины: для каждой вершины вес и последнее ребро пути
+    using ShortestPathTree = ShortestPaths<Weight>;
+
+    void CheckEdgeWeights(const Graph& graph) const {
+        for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+            if (graph.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+                throw std::domain_error("Edges' weights should be non-negative");
+            }
+        }
+    }
+
+    // Блочный Флойд–Уоршелл: матрица делится на квадраты ALL_PAIRS_BLOCK_SIZE x ALL_PAIRS_BLOCK_SIZE;
+    // на шаге kb сначала считается диагональный блок, затем его строка и столбец,
+    // затем все остальные блоки. Блоки внутри фазы независимы и считаются параллельно.
+    void BuildAllPairsTable();
+    void InitializeAllPairsTable();
+    void RelaxAllPairsBlock(size_t block_row, size_t block_column, size_t block_through);
+    std::optional<RouteInfo> UnpackAllPairsRoute(VertexId from, VertexId to) const;
+
+    // Компактная таблица заполняется по строкам деревьями Дейкстры (параллельно по исходным
+    // вершинам), поэтому пиковая память — сама таблица плюс по дереву на поток. Вес пути при
+    // распаковке суммируется заново по рёбрам в полной точности, в том же порядке, что
+    // и в поиске, так что маршруты и веса совпадают с режимом ON_DEMAND.
+    void BuildCompactTable();
+    void FillCompactRow(VertexId from);
+    std::optional<RouteInfo> UnpackCompactRoute(VertexId from, VertexId to) const;
+    // Пересчитывает деревом Дейкстры одну строку таблицы Флойда–Уоршелла
+    void FillAllPairsRow(VertexId from);
+
+    void UpdateTableRows(const std::vector<EdgeId>& changed_edges);
+    void InvalidateCachedTrees(const std::vector<EdgeId>& changed_edges);
+
+    // Дейкстра BuildShortestPaths; если задан target, поиск останавливается, как только он извлечён.
+    // В режиме A_STAR ключ очереди дополняется потенциалом до target.
+    ShortestPathTree BuildShortestPathTree(VertexId from, std::optional<VertexId> target,
+                                           size_t* settled_vertices = nullptr) const;
+    std::optional<RouteInfo> UnpackRoute(const ShortestPathTree& tree, VertexId to) const;
+    // Поиск встречными волнами по прямым и обратным спискам рёбер
+    std::optional<RouteInfo> BuildRouteBidirectional(VertexId from, VertexId to) const;
+    // Наибольшая из оценок SetPotential и ориентиров
+    Weight GetPotential(VertexId vertex, VertexId target) const;
+
+    size_t GetTreeSize() const {
+        return graph_.GetVertexCount() * (sizeof(Weight) + sizeof(EdgeId));
+    }
+    bool IsTreeCacheEnabled() const;
+    // Возвращает дерево из кэша или строит его, вытесняя давно не использованные деревья.
+    // Дерево строится без блокировки кэша, поэтому промахи из разных потоков не ждут друг
+    // друга; выданное дерево остаётся целым, даже если его тут же вытеснят.
+    std::shared_ptr<const ShortestPathTree> GetCachedTree(VertexId from) const;
+    // Вытесняет деревья, пока кэш занимает больше budget_bytes
+    void EvictTrees(size_t budget_bytes) const;
+
+    struct CachedTree {
+        std::shared_ptr<const ShortestPathTree> tree;
+        std::list<VertexId>::iterator lru_position;
+    };
+
+    static constexpr Weight ZERO_WEIGHT{};
+    static constexpr size_t ALL_PAIRS_BLOCK_SIZE = 64;
+
+    const Graph& graph_;
+    RouterMode mode_;
+    // Таблица всех пар построчно: ячейка from * V + to хранит вес пути и его последнее ребро
+    FlatArray<Weight> all_pairs_weights_;
+    FlatArray<EdgeId> all_pairs_prev_edges_;
+
+    struct CompactRouteData {
+        float weight;
+        uint32_t prev_edge;
     };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
+    static constexpr uint32_t COMPACT_NO_EDGE = std::numeric_limits<uint32_t>::max();
+    FlatArray<CompactRouteData> compact_routes_;
+    std::unique_ptr<ContractionHierarchy<Weight>> hierarchy_;
+    Potential potential_;
+    std::unique_ptr<Landmarks<Weight>> landmarks_;
+
+    size_t tree_cache_budget_ = 0;
+    mutable std::mutex tree_cache_mutex_;
+    mutable std::unordered_map<VertexId, CachedTree> tree_cache_;
+    mutable std::list<VertexId> tree_cache_lru_;    // в начале — недавно использованные
+    mutable TreeCacheStats tree_cache_stats_;
+};
 
-    void InitializeRoutesInternalData(const Graph& graph) {
+template <typename Weight>
+Router<Weight>::Router(const Graph& graph, RouterMode mode)
+    : graph_(graph)
+    , mode_(mode)
+{
+    CheckEdgeWeights(graph);
+    if (mode_ == RouterMode::BIDIRECTIONAL && !graph.IsFrozen()) {
+        throw std::logic_error("Bidirectional search requires a frozen graph");
+    }
+    if (mode_ == RouterMode::CONTRACTION_HIERARCHIES) {
+        hierarchy_ = std::make_unique<ContractionHierarchy<Weight>>(graph);
+    }
+    if (mode_ == RouterMode::ALL_PAIRS) {
+        BuildAllPairsTable();
+    } else if (mode_ == RouterMode::ALL_PAIRS_COMPACT) {
+        BuildCompactTable();
+    }
+}
+
+template <typename Weight>
+Router<Weight>::Router(const Graph& graph, RouterMode mode, serialization::Reader& reader)
+    : graph_(graph)
+    , mode_(mode)
+{
+    CheckEdgeWeights(graph);
+    if (mode_ == RouterMode::BIDIRECTIONAL && !graph.IsFrozen()) {
+        throw std::logic_error("Bidirectional search requires a frozen graph");
+    }
+
+    const size_t cell_count = graph.GetVertexCount() * graph.GetVertexCount();
+    auto attach = [&](auto& table) {
+        using Cell = std::remove_const_t<std::remove_pointer_t<decltype(table.Data())>>;
+        size_t count = 0;
+        const Cell* data = reader.ReadArray<Cell>(count);
+        if (count != cell_count) {
+            throw serialization::FormatError("Routing table size mismatch");
+        }
+        table.Attach(reader.GetOwner(), data, count);
+    };
+    // Последнее ребро пути в вершину to должно существовать и вести в to: тогда восстановление
+    // пути по таблице не выходит за пределы графа
+    auto check_prev_edges = [&](auto get_prev_edge) {
         const size_t vertex_count = graph.GetVertexCount();
-        for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-            routes_internal_data_[vertex][vertex] = RouteInternalData{ZERO_WEIGHT, std::nullopt};
-            for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
-                const auto& edge = graph.GetEdge(edge_id);
-                if (edge.weight < ZERO_WEIGHT) {
-                    throw std::domain_error("Edges' weights should be non-negative");
-                }
-                auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-                if (!route_internal_data || route_internal_data->weight > edge.weight) {
-                    route_internal_data = RouteInternalData{edge.weight, edge_id};
-                }
+        for (size_t cell = 0; cell < cell_count; ++cell) {
+            const EdgeId edge_id = get_prev_edge(cell);
+            if (edge_id != NO_EDGE
+                && (edge_id >= graph.GetEdgeCount() || graph.GetEdge(edge_id).to != cell % vertex_count)) {
+                throw serialization::FormatError("Routing table edge is out of range");
             }
         }
+    };
+    if (mode_ == RouterMode::ALL_PAIRS) {
+        attach(all_pairs_weights_);
+        attach(all_pairs_prev_edges_);
+        check_prev_edges([this](size_t cell) { return all_pairs_prev_edges_.Data()[cell]; });
+    } else if (mode_ == RouterMode::ALL_PAIRS_COMPACT) {
+        attach(compact_routes_);
+        check_prev_edges([this](size_t cell) {
+            const uint32_t edge_id = compact_routes_.Data()[cell].prev_edge;
+            return edge_id == COMPACT_NO_EDGE ? NO_EDGE : EdgeId{edge_id};
+        });
+    } else if (mode_ == RouterMode::CONTRACTION_HIERARCHIES) {
+        hierarchy_ = std::make_unique<ContractionHierarchy<Weight>>(reader, graph);
+    } else if (mode_ == RouterMode::A_STAR && reader.ReadPod<uint8_t>() != 0) {
+        landmarks_ = std::make_unique<Landmarks<Weight>>(reader, graph.GetVertexCount());
     }
+}
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to, const RouteInternalData& route_from,
-                    const RouteInternalData& route_to) {
-        auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-        const Weight candidate_weight = route_from.weight + route_to.weight;
-        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-            route_relaxing = {candidate_weight,
-                              route_to.prev_edge ? route_to.prev_edge : route_from.prev_edge};
+template <typename Weight>
+void Router<Weight>::SaveState(serialization::Writer& writer) const {
+    if (mode_ == RouterMode::ALL_PAIRS) {
+        writer.WriteArray(all_pairs_weights_.Data(), all_pairs_weights_.Size());
+        writer.WriteArray(all_pairs_prev_edges_.Data(), all_pairs_prev_edges_.Size());
+    } else if (mode_ == RouterMode::ALL_PAIRS_COMPACT) {
+        writer.WriteArray(compact_routes_.Data(), compact_routes_.Size());
+    } else if (mode_ == RouterMode::CONTRACTION_HIERARCHIES) {
+        hierarchy_->Save(writer);
+    } else if (mode_ == RouterMode::A_STAR) {
+        writer.WritePod<uint8_t>(landmarks_ ? 1 : 0);
+        if (landmarks_) {
+            landmarks_->Save(writer);
         }
     }
+}
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-        for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-            if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-                for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-                    if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-                        RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-                    }
-                }
+template <typename Weight>
+void Router<Weight>::BuildCompactTable() {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (graph_.GetEdgeCount() >= COMPACT_NO_EDGE) {
+        throw std::length_error("Too many edges for the compact routing table");
+    }
+    compact_routes_.Assign(vertex_count * vertex_count,
+                           CompactRouteData{std::numeric_limits<float>::infinity(), COMPACT_NO_EDGE});
+
+    parallel::ForEachIndex(vertex_count, [&](size_t from) {
+        FillCompactRow(from);
+    });
+}
+
+template <typename Weight>
+void Router<Weight>::FillCompactRow(VertexId from) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    const ShortestPathTree paths = BuildShortestPathTree(from, std::nullopt);
+    CompactRouteData* row = compact_routes_.MutableData() + from * vertex_count;
+    for (VertexId to = 0; to < vertex_count; ++to) {
+        row[to] = CompactRouteData{std::numeric_limits<float>::infinity(), COMPACT_NO_EDGE};
+        if (paths.weights[to] != UNREACHABLE<Weight>) {
+            row[to].weight = static_cast<float>(paths.weights[to]);
+            if (paths.prev_edges[to] != NO_EDGE) {
+                row[to].prev_edge = static_cast<uint32_t>(paths.prev_edges[to]);
             }
         }
     }
+}
 
-    static constexpr Weight ZERO_WEIGHT{};
-    const Graph& graph_;
-    RoutesInternalData routes_internal_data_;
-};
+template <typename Weight>
+void Router<Weight>::FillAllPairsRow(VertexId from) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    const ShortestPathTree paths = BuildShortestPathTree(from, std::nullopt);
+    std::copy(paths.weights.begin(), paths.weights.end(), all_pairs_weights_.MutableData() + from * vertex_count);
+    std::copy(paths.prev_edges.begin(), paths.prev_edges.end(),
+              all_pairs_prev_edges_.MutableData() + from * vertex_count);
+}
 
 template <typename Weight>
-Router<Weight>::Router(const Graph& graph)
-    : graph_(graph)
-    , routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
-{
-    InitializeRoutesInternalData(graph);
+void Router<Weight>::UpdateEdges(const std::vector<EdgeId>& changed_edges) {
+    CheckEdgeWeights(graph_);
+    if (mode_ == RouterMode::BIDIRECTIONAL && !graph_.IsFrozen()) {
+        throw std::logic_error("Bidirectional search requires a frozen graph");
+    }
+    if (mode_ == RouterMode::CONTRACTION_HIERARCHIES) {
+        hierarchy_ = std::make_unique<ContractionHierarchy<Weight>>(graph_);
+    } else if (mode_ == RouterMode::ALL_PAIRS || mode_ == RouterMode::ALL_PAIRS_COMPACT) {
+        UpdateTableRows(changed_edges);
+    } else {
+        if (landmarks_) {
+            landmarks_->Update(graph_, changed_edges);
+        }
+        InvalidateCachedTrees(changed_edges);
+    }
+}
 
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-        RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+template <typename Weight>
+void Router<Weight>::UpdateTableRows(const std::vector<EdgeId>& changed_edges) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    const bool is_compact = mode_ == RouterMode::ALL_PAIRS_COMPACT;
+    const size_t cell_count = is_compact ? compact_routes_.Size() : all_pairs_weights_.Size();
+    if (cell_count != vertex_count * vertex_count) {
+        // Появились новые вершины: таблица меняет размер целиком
+        if (is_compact) {
+            BuildCompactTable();
+        } else {
+            BuildAllPairsTable();
+        }
+        return;
     }
+
+    std::vector<char> is_affected(vertex_count, 0);
+    parallel::ForEachIndex(vertex_count, [&](size_t from) {
+        if (is_compact) {
+            const CompactRouteData* row = compact_routes_.Data() + from * vertex_count;
+            // Веса в таблице округлены до float: лишний пересчёт строки лучше пропущенного
+            is_affected[from] = IsAffectedByEdges(
+                graph_, changed_edges,
+                [row](VertexId v) {
+                    return row[v].weight == std::numeric_limits<float>::infinity()
+                        ? UNREACHABLE<Weight> : static_cast<Weight>(row[v].weight);
+                },
+                [row](VertexId v) {
+                    return row[v].prev_edge == COMPACT_NO_EDGE ? NO_EDGE : EdgeId{row[v].prev_edge};
+                },
+                false, static_cast<Weight>(1e-6));
+        } else {
+            const Weight* weights = all_pairs_weights_.Data() + from * vertex_count;
+            const EdgeId* prev_edges = all_pairs_prev_edges_.Data() + from * vertex_count;
+            is_affected[from] = IsAffectedByEdges(
+                graph_, changed_edges,
+                [weights](VertexId v) { return weights[v]; },
+                [prev_edges](VertexId v) { return prev_edges[v]; });
+        }
+    });
+
+    std::vector<VertexId> affected_rows;
+    for (VertexId from = 0; from < vertex_count; ++from) {
+        if (is_affected[from]) {
+            affected_rows.push_back(from);
+        }
+    }
+    // Таблица могла быть отображена из файла: перед правкой копируем её в память
+    compact_routes_.MakeOwned();
+    all_pairs_weights_.MakeOwned();
+    all_pairs_prev_edges_.MakeOwned();
+    parallel::ForEachIndex(affected_rows.size(), [&](size_t index) {
+        if (is_compact) {
+            FillCompactRow(affected_rows[index]);
+        } else {
+            FillAllPairsRow(affected_rows[index]);
+        }
+    });
 }
 
 template <typename Weight>
-std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
-                                                                             VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-    if (!route_internal_data) {
+void Router<Weight>::InvalidateCachedTrees(const std::vector<EdgeId>& changed_edges) {
+    std::lock_guard guard(tree_cache_mutex_);
+    const size_t vertex_count = graph_.GetVertexCount();
+    for (auto it = tree_cache_.begin(); it != tree_cache_.end();) {
+        const ShortestPathTree& tree = *it->second.tree;
+        const bool is_stale = tree.weights.size() != vertex_count || IsAffectedByEdges(
+            graph_, changed_edges,
+            [&tree](VertexId v) { return tree.weights[v]; },
+            [&tree](VertexId v) { return tree.prev_edges[v]; });
+        if (!is_stale) {
+            ++it;
+            continue;
+        }
+        tree_cache_stats_.memory_used -= tree.weights.size() * (sizeof(Weight) + sizeof(EdgeId));
+        --tree_cache_stats_.cached_trees;
+        ++tree_cache_stats_.invalidations;
+        tree_cache_lru_.erase(it->second.lru_position);
+        it = tree_cache_.erase(it);
+    }
+}
+
+template <typename Weight>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::UnpackCompactRoute(
+    VertexId from, VertexId to) const
+{
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    const CompactRouteData* row = compact_routes_.Data() + from * vertex_count;
+    if (row[to].weight == std::numeric_limits<float>::infinity()) {
         return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
+
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge)
-    {
-        edges.push_back(*edge_id);
+    for (uint32_t edge_id = row[to].prev_edge; edge_id != COMPACT_NO_EDGE;
+         edge_id = row[graph_.GetEdge(edge_id).from].prev_edge) {
+        edges.push_back(edge_id);
     }
     std::reverse(edges.begin(), edges.end());
 
+    Weight weight = ZERO_WEIGHT;
+    for (const EdgeId edge_id : edges) {
+        weight = weight + graph_.GetEdge(edge_id).weight;
+    }
     return RouteInfo{weight, std::move(edges)};
 }
 
-}  // namespace graph
\ No newline at end of file
+template <typename Weight>
+void Router<Weight>::InitializeAllPairsTable() {
+    const size_t vertex_count = graph_.GetVertexCount();
+    all_pairs_weights_.Assign(vertex_count * vertex_count, UNREACHABLE<Weight>);
+    all_pairs_prev_edges_.Assign(vertex_count * vertex_count, NO_EDGE);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        Weight* weights = all_pairs_weights_.MutableData() + vertex * vertex_count;
+        EdgeId* prev_edges = all_pairs_prev_edges_.MutableData() + vertex * vertex_count;
+        weights[vertex] = ZERO_WEIGHT;
+        graph_.ForEachOutgoingEdge(vertex, [&](EdgeId edge_id, VertexId to, Weight weight) {
+            if (weight < weights[to]) {
+                weights[to] = weight;
+                prev_edges[to] = edge_id;
+            }
+        });
+    }
+}
+
+template <typename Weight>
+void Router<Weight>::RelaxAllPairsBlock(size_t block_row, size_t block_column,
+                                        size_t block_through) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    const size_t row_begin = block_row * ALL_PAIRS_BLOCK_SIZE;
+    const size_t row_end = std::min(row_begin + ALL_PAIRS_BLOCK_SIZE, vertex_count);
+    const size_t column_begin = block_column * ALL_PAIRS_BLOCK_SIZE;
+    const size_t column_end = std::min(column_begin + ALL_PAIRS_BLOCK_SIZE, vertex_count);
+    const size_t through_begin = block_through * ALL_PAIRS_BLOCK_SIZE;
+    const size_t through_end = std::min(through_begin + ALL_PAIRS_BLOCK_SIZE, vertex_count);
+
+    for (VertexId through = through_begin; through < through_end; ++through) {
+        const Weight* through_weights = all_pairs_weights_.Data() + through * vertex_count;
+        const EdgeId* through_prev_edges = all_pairs_prev_edges_.Data() + through * vertex_count;
+        for (VertexId from = row_begin; from < row_end; ++from) {
+            Weight* weights = all_pairs_weights_.MutableData() + from * vertex_count;
+            EdgeId* prev_edges = all_pairs_prev_edges_.MutableData() + from * vertex_count;
+            const Weight weight_to_through = weights[through];
+            if (weight_to_through == UNREACHABLE<Weight>) {
+                continue;
+            }
+            // Последнее ребро пути from -> through -> to совпадает с последним ребром
+            // through -> to: путь through -> through пуст только при to == through,
+            // а тогда кандидат не короче текущего значения
+            for (VertexId to = column_begin; to < column_end; ++to) {
+                const Weight candidate_weight = weight_to_through + through_weights[to];
+                const bool is_shorter = candidate_weight < weights[to];
+                weights[to] = is_shorter ? candidate_weight : weights[to];
+                prev_edges[to] = is_shorter ? through_prev_edges[to] : prev_edges[to];
+            }
+        }
+    }
+}
+
+template <typename Weight>
+void Router<Weight>::BuildAllPairsTable() {
+    InitializeAllPairsTable();
+
+    const size_t block_count =
+        (graph_.GetVertexCount() + ALL_PAIRS_BLOCK_SIZE - 1) / ALL_PAIRS_BLOCK_SIZE;
+    for (size_t block_through = 0; block_through < block_count; ++block_through) {
+        RelaxAllPairsBlock(block_through, block_through, block_through);
+
+        // Строка и столбец диагонального блока зависят только от него
+        parallel::ForEachIndex(2 * block_count, [&](size_t index) {
+            const size_t block = index / 2;
+            if (block == block_through) {
+                return;
+            }
+            if (index % 2 == 0) {
+                RelaxAllPairsBlock(block_through, block, block_through);
+            } else {
+                RelaxAllPairsBlock(block, block_through, block_through);
+            }
+        });
+
+        // Остальные блоки зависят только от строки и столбца
+        parallel::ForEachIndex(block_count, [&](size_t block_row) {
+            if (block_row == block_through) {
+                return;
+            }
+            for (size_t block_column = 0; block_column < block_count; ++block_column) {
+                if (block_column != block_through) {
+                    RelaxAllPairsBlock(block_row, block_column, block_through);
+                }
+            }
+        });
+    }
+}
+
+template <typename Weight>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::UnpackAllPairsRoute(
+    VertexId from, VertexId to) const
+{
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    const Weight* weights = all_pairs_weights_.Data() + from * vertex_count;
+    const EdgeId* prev_edges = all_pairs_prev_edges_.Data() + from * vertex_count;
+    if (weights[to] == UNREACHABLE<Weight>) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = prev_edges[to]; edge_id != NO_EDGE;
+         edge_id = prev_edges[graph_.GetEdge(edge_id).from]) {
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{weights[to], std::move(edges)};
+}
+
+template <typename Weight>
+typename Router<Weight>::ShortestPathTree Router<Weight>::BuildShortestPathTree(
+    VertexId from, std::optional<VertexId> target, size_t* settled_vertices) const
+{
+    if (mode_ == RouterMode::A_STAR && target && (potential_ || landmarks_)) {
+        return BuildShortestPaths(
+            graph_, from, false, target,
+            [this, to = *target](VertexId vertex) { return GetPotential(vertex, to); }, settled_vertices);
+    }
+    return BuildShortestPaths(graph_, from, false, target, ZeroPotential<Weight>{}, settled_vertices);
+}
+
+template <typename Weight>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::UnpackRoute(
+    const ShortestPathTree& tree, VertexId to) const
+{
+    if (tree.weights.at(to) == UNREACHABLE<Weight>) {
+        return std::nullopt;
+    }
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = tree.prev_edges[to]; edge_id != NO_EDGE;
+         edge_id = tree.prev_edges[graph_.GetEdge(edge_id).from]) {
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{tree.weights[to], std::move(edges)};
+}
+
+template <typename Weight>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRouteBidirectional(
+    VertexId from, VertexId to) const
+{
+    if (from == to) {
+        return RouteInfo{ZERO_WEIGHT, {}, 0};
+    }
+
+    // Прямая волна хранит пути from -> v, обратная — пути v -> to
+    struct Search {
+        ShortestPathTree tree;
+        std::vector<bool> settled;
+        MonotoneQueue<Weight> queue;
+    };
+    const size_t vertex_count = graph_.GetVertexCount();
+    auto make_tree = [vertex_count] {
+        return ShortestPathTree{std::vector<Weight>(vertex_count, UNREACHABLE<Weight>),
+                                std::vector<EdgeId>(vertex_count, NO_EDGE)};
+    };
+    Search forward{make_tree(), std::vector<bool>(vertex_count, false), {}};
+    Search backward{make_tree(), std::vector<bool>(vertex_count, false), {}};
+    forward.tree.weights[from] = ZERO_WEIGHT;
+    forward.queue.push({ZERO_WEIGHT, from});
+    backward.tree.weights[to] = ZERO_WEIGHT;
+    backward.queue.push({ZERO_WEIGHT, to});
+
+    // Лучший найденный путь проходит по ребру meeting_edge: from -> tail -> head -> to
+    std::optional<Weight> best_weight;
+    EdgeId meeting_edge = 0;
+    size_t settled_vertices = 0;
+    auto try_meeting = [&](EdgeId edge_id, VertexId tail, VertexId head, Weight edge_weight) {
+        const Weight to_tail = forward.tree.weights[tail];
+        const Weight from_head = backward.tree.weights[head];
+        if (to_tail == UNREACHABLE<Weight> || from_head == UNREACHABLE<Weight>) {
+            return;
+        }
+        const Weight candidate_weight = to_tail + edge_weight + from_head;
+        if (!best_weight || candidate_weight < *best_weight) {
+            best_weight = candidate_weight;
+            meeting_edge = edge_id;
+        }
+    };
+    auto pop_settled = [&settled_vertices](Search& search) -> std::optional<VertexId> {
+        while (!search.queue.empty()) {
+            const VertexId vertex = search.queue.top().second;
+            search.queue.pop();
+            if (!search.settled[vertex]) {
+                search.settled[vertex] = true;
+                ++settled_vertices;
+                return vertex;
+            }
+        }
+        return std::nullopt;
+    };
+    auto relax = [](Search& search, VertexId vertex, EdgeId edge_id, Weight candidate_weight) {
+        if (!search.settled[vertex] && candidate_weight < search.tree.weights[vertex]) {
+            search.tree.weights[vertex] = candidate_weight;
+            search.tree.prev_edges[vertex] = edge_id;
+            search.queue.push({candidate_weight, vertex});
+        }
+    };
+
+    while (!forward.queue.empty() && !backward.queue.empty()) {
+        // Волны встретились: ни одна из них уже не улучшит найденный путь
+        if (best_weight
+            && !(forward.queue.top().first + backward.queue.top().first < *best_weight)) {
+            break;
+        }
+        if (!(backward.queue.top().first < forward.queue.top().first)) {
+            const auto vertex = pop_settled(forward);
+            if (!vertex) {
+                break;
+            }
+            const Weight weight = forward.tree.weights[*vertex];
+            graph_.ForEachOutgoingEdge(*vertex, [&](EdgeId edge_id, VertexId head, Weight edge_weight) {
+                relax(forward, head, edge_id, weight + edge_weight);
+                try_meeting(edge_id, *vertex, head, edge_weight);
+            });
+        } else {
+            const auto vertex = pop_settled(backward);
+            if (!vertex) {
+                break;
+            }
+            const Weight weight = backward.tree.weights[*vertex];
+            graph_.ForEachIncomingEdge(*vertex, [&](EdgeId edge_id, VertexId tail, Weight edge_weight) {
+                relax(backward, tail, edge_id, weight + edge_weight);
+                try_meeting(edge_id, tail, *vertex, edge_weight);
+            });
+        }
+    }
+
+    if (!best_weight) {
+        return std::nullopt;
+    }
+
+    const auto& middle_edge = graph_.GetEdge(meeting_edge);
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = forward.tree.prev_edges[middle_edge.from]; edge_id != NO_EDGE;
+         edge_id = forward.tree.prev_edges[graph_.GetEdge(edge_id).from]) {
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+    edges.push_back(meeting_edge);
+    for (EdgeId edge_id = backward.tree.prev_edges[middle_edge.to]; edge_id != NO_EDGE;
+         edge_id = backward.tree.prev_edges[graph_.GetEdge(edge_id).to]) {
+        edges.push_back(edge_id);
+    }
+
+    return RouteInfo{*best_weight, std::move(edges), settled_vertices};
+}
+
+template <typename Weight>
+std::vector<std::optional<typename Router<Weight>::RouteInfo>> Router<Weight>::BuildRoutes(
+    VertexId from, const std::vector<VertexId>& targets) const
+{
+    std::vector<std::optional<RouteInfo>> routes;
+    routes.reserve(targets.size());
+    if (mode_ == RouterMode::ALL_PAIRS || mode_ == RouterMode::ALL_PAIRS_COMPACT
+        || mode_ == RouterMode::CONTRACTION_HIERARCHIES || targets.size() == 1) {
+        // Готовые таблицы и иерархия отвечают на каждую пару и так быстро
+        for (const VertexId to : targets) {
+            routes.push_back(BuildRoute(from, to));
+        }
+        return routes;
+    }
+
+    if (from >= graph_.GetVertexCount()) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    std::shared_ptr<const ShortestPathTree> tree;
+    if (mode_ == RouterMode::ON_DEMAND && IsTreeCacheEnabled()) {
+        tree = GetCachedTree(from);
+    } else {
+        tree = std::make_shared<const ShortestPathTree>(BuildShortestPathTree(from, std::nullopt));
+    }
+    for (const VertexId to : targets) {
+        routes.push_back(UnpackRoute(*tree, to));
+    }
+    return routes;
+}
+
+template <typename Weight>
+std::vector<std::optional<Weight>> Router<Weight>::BuildWeightMatrix(
+    const std::vector<VertexId>& sources, const std::vector<VertexId>& targets) const
+{
+    if (mode_ == RouterMode::CONTRACTION_HIERARCHIES) {
+        return hierarchy_->FindWeightMatrix(sources, targets);
+    }
+    const size_t vertex_count = graph_.GetVertexCount();
+    for (const auto& vertices : {&sources, &targets}) {
+        for (const VertexId vertex : *vertices) {
+            if (vertex >= vertex_count) {
+                throw std::out_of_range("Vertex id is out of range");
+            }
+        }
+    }
+
+    std::vector<std::optional<Weight>> matrix(sources.size() * targets.size());
+    parallel::ForEachIndex(sources.size(), [&](size_t source) {
+        const VertexId from = sources[source];
+        std::optional<Weight>* row = matrix.data() + source * targets.size();
+        if (mode_ == RouterMode::ALL_PAIRS) {
+            const Weight* weights = all_pairs_weights_.Data() + from * vertex_count;
+            for (size_t target = 0; target < targets.size(); ++target) {
+                if (weights[targets[target]] != UNREACHABLE<Weight>) {
+                    row[target] = weights[targets[target]];
+                }
+            }
+        } else if (mode_ == RouterMode::ALL_PAIRS_COMPACT) {
+            // В таблице вес округлён до float; точный вес, как и в BuildRoute, суммируется по рёбрам
+            for (size_t target = 0; target < targets.size(); ++target) {
+                if (auto route = UnpackCompactRoute(from, targets[target])) {
+                    row[target] = route->weight;
+                }
+            }
+        } else {
+            // Одно дерево на источник вместо поиска на каждую пару
+            const ShortestPathTree tree = BuildShortestPathTree(from, std::nullopt);
+            for (size_t target = 0; target < targets.size(); ++target) {
+                if (tree.weights[targets[target]] != UNREACHABLE<Weight>) {
+                    row[target] = tree.weights[targets[target]];
+                }
+            }
+        }
+    });
+    return matrix;
+}
+
+template <typename Weight>
+std::vector<std::pair<VertexId, Weight>> Router<Weight>::FindReachable(VertexId from, Weight max_weight) const {
+    if (from >= graph_.GetVertexCount()) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+    std::vector<std::pair<VertexId, Weight>> reachable;
+    if (max_weight < ZERO_WEIGHT) {
+        return reachable;
+    }
+
+    // Веса храним только для встреченных вершин: область поиска может быть много меньше графа
+    std::unordered_map<VertexId, Weight> weights;
+    MonotoneQueue<Weight> queue;
+    weights.emplace(from, ZERO_WEIGHT);
+    queue.push({ZERO_WEIGHT, from});
+    while (!queue.empty()) {
+        const auto [weight, vertex] = queue.top();
+        queue.pop();
+        if (weights.at(vertex) < weight) {
+            continue;  // устаревшая запись в очереди
+        }
+        reachable.emplace_back(vertex, weight);
+        graph_.ForEachOutgoingEdge(vertex, [&](EdgeId, VertexId to, Weight edge_weight) {
+            const Weight candidate_weight = weight + edge_weight;
+            if (max_weight < candidate_weight) {
+                return;
+            }
+            auto [it, inserted] = weights.try_emplace(to, candidate_weight);
+            if (inserted || candidate_weight < it->second) {
+                it->second = candidate_weight;
+                queue.push({candidate_weight, to});
+            }
+        });
+    }
+    return reachable;
+}
+
+template <typename Weight>
+void Router<Weight>::SetTreeCacheBudget(size_t budget_bytes) {
+    std::lock_guard guard(tree_cache_mutex_);
+    tree_cache_budget_ = budget_bytes;
+    EvictTrees(tree_cache_budget_);
+}
+
+template <typename Weight>
+void Router<Weight>::SetPotential(Potential potential) {
+    potential_ = std::move(potential);
+}
+
+template <typename Weight>
+void Router<Weight>::BuildLandmarks(const std::vector<VertexId>& candidates, size_t landmark_count) {
+    landmarks_ = landmark_count > 0
+        ? std::make_unique<Landmarks<Weight>>(graph_, candidates, landmark_count)
+        : nullptr;
+}
+
+template <typename Weight>
+Weight Router<Weight>::GetPotential(VertexId vertex, VertexId target) const {
+    Weight potential = potential_ ? potential_(vertex, target) : ZERO_WEIGHT;
+    if (landmarks_) {
+        potential = std::max(potential, landmarks_->GetLowerBound(vertex, target));
+    }
+    return potential;
+}
+
+template <typename Weight>
+TreeCacheStats Router<Weight>::GetTreeCacheStats() const {
+    std::lock_guard guard(tree_cache_mutex_);
+    return tree_cache_stats_;
+}
+
+template <typename Weight>
+void Router<Weight>::EvictTrees(size_t budget_bytes) const {
+    while (!tree_cache_lru_.empty() && tree_cache_stats_.memory_used > budget_bytes) {
+        auto it = tree_cache_.find(tree_cache_lru_.back());
+        const ShortestPathTree& tree = *it->second.tree;
+        tree_cache_stats_.memory_used -= tree.weights.size() * (sizeof(Weight) + sizeof(EdgeId));
+        tree_cache_.erase(it);
+        tree_cache_lru_.pop_back();
+        --tree_cache_stats_.cached_trees;
+        ++tree_cache_stats_.evictions;
+    }
+}
+
+template <typename Weight>
+bool Router<Weight>::IsTreeCacheEnabled() const {
+    std::lock_guard guard(tree_cache_mutex_);
+    return tree_cache_budget_ >= GetTreeSize();
+}
+
+template <typename Weight>
+std::shared_ptr<const typename Router<Weight>::ShortestPathTree> Router<Weight>::GetCachedTree(
+    VertexId from) const {
+    {
+        std::lock_guard guard(tree_cache_mutex_);
+        if (auto it = tree_cache_.find(from); it != tree_cache_.end()) {
+            ++tree_cache_stats_.hits;
+            tree_cache_lru_.splice(tree_cache_lru_.begin(), tree_cache_lru_, it->second.lru_position);
+            return it->second.tree;
+        }
+        ++tree_cache_stats_.misses;
+    }
+
+    auto tree = std::make_shared<const ShortestPathTree>(BuildShortestPathTree(from, std::nullopt));
+    const size_t tree_size = GetTreeSize();
+
+    std::lock_guard guard(tree_cache_mutex_);
+    // Пока дерево строилось, то же дерево мог положить в кэш другой поток
+    if (auto it = tree_cache_.find(from); it != tree_cache_.end()) {
+        return it->second.tree;
+    }
+    if (tree_cache_budget_ < tree_size) {
+        return tree;
+    }
+    EvictTrees(tree_cache_budget_ - tree_size);
+    tree_cache_lru_.push_front(from);
+    tree_cache_stats_.memory_used += tree_size;
+    ++tree_cache_stats_.cached_trees;
+    tree_cache_[from] = CachedTree{tree, tree_cache_lru_.begin()};
+    return tree;
+}
+
+template <typename Weight>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from,
+                                                                             VertexId to) const {
+    if (mode_ == RouterMode::ALL_PAIRS) {
+        return UnpackAllPairsRoute(from, to);
+    }
+    if (mode_ == RouterMode::ALL_PAIRS_COMPACT) {
+        return UnpackCompactRoute(from, to);
+    }
+    if (mode_ == RouterMode::CONTRACTION_HIERARCHIES) {
+        auto path = hierarchy_->FindPath(from, to);
+        if (!path) {
+            return std::nullopt;
+        }
+        return RouteInfo{path->weight, std::move(path->edges), path->settled_vertices};
+    }
+    if (from >= graph_.GetVertexCount() || to >= graph_.GetVertexCount()) {
+        throw std::out_of_range("Vertex id is out of range");
+    }
+
+    if (mode_ == RouterMode::BIDIRECTIONAL) {
+        return BuildRouteBidirectional(from, to);
+    }
+
+    if (mode_ == RouterMode::A_STAR || !IsTreeCacheEnabled()) {
+        // Поиск только до цели: A* привязан к цели, а в кэш не помещается ни одно дерево
+        size_t settled_vertices = 0;
+        auto route = UnpackRoute(BuildShortestPathTree(from, to, &settled_vertices), to);
+        if (route) {
+            route->settled_vertices = settled_vertices;
+        }
+        return route;
+    }
+    return UnpackRoute(*GetCachedTree(from), to);
+}
+
+}  // namespace graph
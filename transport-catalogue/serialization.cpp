@@ -0,0 +1,137 @@
+#include "serialization.h"
+
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TRANSPORT_HAS_MMAP 1
+#endif
+
+namespace serialization {
+
+using namespace std::literals;
+
+void Checksum::Add(const void* data, size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash_ ^= bytes[i];
+        hash_ *= 1099511628211ULL;
+    }
+}
+
+void Checksum::Add(std::string_view text) {
+    AddPod<uint64_t>(text.size());
+    Add(text.data(), text.size());
+}
+
+void Writer::WriteBytes(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    checksum_.Add(data, size);
+    position_ += size;
+}
+
+void Writer::WriteString(std::string_view text) {
+    WritePod<uint64_t>(text.size());
+    WriteBytes(text.data(), text.size());
+}
+
+void Writer::AlignTo(size_t alignment) {
+    static const char zeros[ARRAY_ALIGNMENT] = {};
+    const size_t padding = (alignment - position_ % alignment) % alignment;
+    WriteBytes(zeros, padding);
+}
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef TRANSPORT_HAS_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw FormatError("Cannot open "s + path);
+    }
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0) {
+        ::close(fd);
+        throw FormatError("Cannot stat "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* address = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            data_ = static_cast<const char*>(address);
+            is_mapped_ = true;
+        }
+    }
+    ::close(fd);
+    if (is_mapped_ || size_ == 0) {
+        return;
+    }
+#endif
+    // Отображение недоступно: читаем файл целиком
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw FormatError("Cannot open "s + path);
+    }
+    in.seekg(0, std::ios::end);
+    size_ = static_cast<size_t>(in.tellg());
+    in.seekg(0, std::ios::beg);
+    // new char[] выравнивает по крайней мере на alignof(std::max_align_t)
+    buffer_ = std::make_unique<char[]>(size_);
+    if (!in.read(buffer_.get(), static_cast<std::streamsize>(size_))) {
+        throw FormatError("Cannot read "s + path);
+    }
+    data_ = buffer_.get();
+}
+
+MappedFile::~MappedFile() {
+#ifdef TRANSPORT_HAS_MMAP
+    if (is_mapped_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+void Reader::ReadBytes(void* data, size_t size) {
+    if (size > file_->GetSize() - position_) {
+        throw FormatError("Unexpected end of file");
+    }
+    std::memcpy(data, file_->GetData() + position_, size);
+    position_ += size;
+}
+
+std::string Reader::ReadString() {
+    const auto size = ReadPod<uint64_t>();
+    if (size > file_->GetSize() - position_) {
+        throw FormatError("Unexpected end of file");
+    }
+    std::string text(file_->GetData() + position_, size);
+    position_ += size;
+    return text;
+}
+
+void Reader::AlignTo(size_t alignment) {
+    const size_t padding = (alignment - position_ % alignment) % alignment;
+    if (padding > file_->GetSize() - position_) {
+        throw FormatError("Unexpected end of file");
+    }
+    position_ += padding;
+}
+
+void Reader::CheckTrailingChecksum() const {
+    const size_t size = file_->GetSize();
+    if (size < sizeof(uint64_t)) {
+        throw FormatError("Unexpected end of file");
+    }
+    const size_t payload_size = size - sizeof(uint64_t);
+    uint64_t stored = 0;
+    std::memcpy(&stored, file_->GetData() + payload_size, sizeof(stored));
+    Checksum checksum;
+    checksum.Add(file_->GetData(), payload_size);
+    if (checksum.Get() != stored) {
+        throw FormatError("Checksum mismatch");
+    }
+}
+
+}  // namespace serialization
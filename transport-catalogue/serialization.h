@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace serialization {
+
+// Файл повреждён, обрезан или записан в другом формате
+class FormatError : public std::runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
+// Выравнивание массивов в файле: таблицы можно отображать в память и читать на месте
+constexpr size_t ARRAY_ALIGNMENT = 64;
+
+// 64-битный FNV-1a для контрольных сумм входных данных и содержимого файла
+class Checksum {
+public:
+    void Add(const void* data, size_t size);
+    void Add(std::string_view text);
+
+    template <typename T>
+    void AddPod(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Add(&value, sizeof(value));
+    }
+
+    uint64_t Get() const {
+        return hash_;
+    }
+
+private:
+    uint64_t hash_ = 14695981039346656037ULL;
+};
+
+// Двоичная запись в поток в родном порядке байт платформы
+class Writer {
+public:
+    explicit Writer(std::ostream& out)
+        : out_(out) {
+    }
+
+    void WriteBytes(const void* data, size_t size);
+    void WriteString(std::string_view text);
+    void AlignTo(size_t alignment);
+
+    template <typename T>
+    void WritePod(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(value));
+    }
+
+    // Длина и выровненный массив, пригодный для чтения через Reader::ReadArray
+    template <typename T>
+    void WriteArray(const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WritePod<uint64_t>(count);
+        AlignTo(ARRAY_ALIGNMENT);
+        WriteBytes(data, count * sizeof(T));
+    }
+
+    template <typename T>
+    void WriteVector(const std::vector<T>& values) {
+        WriteArray(values.data(), values.size());
+    }
+
+    // Контрольная сумма всех записанных байтов
+    uint64_t GetChecksum() const {
+        return checksum_.Get();
+    }
+
+private:
+    std::ostream& out_;
+    size_t position_ = 0;
+    Checksum checksum_;
+};
+
+// Содержимое файла только для чтения: отображение в память, где оно доступно,
+// иначе — копия в куче
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* GetData() const {
+        return data_;
+    }
+    size_t GetSize() const {
+        return size_;
+    }
+    bool IsMapped() const {
+        return is_mapped_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool is_mapped_ = false;
+    std::unique_ptr<char[]> buffer_;
+};
+
+// Последовательное чтение из MappedFile с проверкой границ
+class Reader {
+public:
+    explicit Reader(std::shared_ptr<const MappedFile> file)
+        : file_(std::move(file)) {
+    }
+
+    void ReadBytes(void* data, size_t size);
+    std::string ReadString();
+    void AlignTo(size_t alignment);
+    // Сверяет последние 8 байт файла с контрольной суммой всех байтов перед ними
+    // (Writer::GetChecksum в конце записи); при несовпадении — FormatError
+    void CheckTrailingChecksum() const;
+
+    template <typename T>
+    T ReadPod() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        ReadBytes(&value, sizeof(value));
+        return value;
+    }
+
+    // Массив, записанный Writer::WriteArray. Указатель ведёт прямо в файл и живёт, пока жив
+    // владелец из GetOwner(); count получает длину массива.
+    template <typename T>
+    const T* ReadArray(size_t& count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        count = ReadPod<uint64_t>();
+        AlignTo(ARRAY_ALIGNMENT);
+        if (count > (file_->GetSize() - position_) / sizeof(T)) {
+            throw FormatError("Unexpected end of file");
+        }
+        const T* data = reinterpret_cast<const T*>(file_->GetData() + position_);
+        position_ += count * sizeof(T);
+        return data;
+    }
+
+    template <typename T>
+    std::vector<T> ReadVector() {
+        size_t count = 0;
+        const T* data = ReadArray<T>(count);
+        return std::vector<T>(data, data + count);
+    }
+
+    std::shared_ptr<const void> GetOwner() const {
+        return file_;
+    }
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    size_t position_ = 0;
+};
+
+}  // namespace serialization
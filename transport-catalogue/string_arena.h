@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace transport::catalogue {
+
+// Хранилище строк справочника: каждая строка хранится один раз в крупных блоках.
+// Блоки не перемещаются, поэтому выданные string_view действительны, пока жива арена.
+class StringArena {
+public:
+    StringArena() = default;
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+    StringArena(StringArena&&) = default;
+    StringArena& operator=(StringArena&&) = default;
+
+    // Копия text в арене; для одинаковых строк возвращается одна и та же копия
+    std::string_view Intern(std::string_view text) {
+        if (text.empty()) {
+            return {};
+        }
+        if (auto it = strings_.find(text); it != strings_.end()) {
+            return *it;
+        }
+        const std::string_view stored = Store(text);
+        strings_.insert(stored);
+        return stored;
+    }
+
+    size_t GetStringCount() const {
+        return strings_.size();
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::string_view Store(std::string_view text) {
+        if (text.size() > block_capacity_ - block_used_) {
+            // Остаток текущего блока пропадает; длинная строка получает блок по размеру
+            block_capacity_ = std::max(BLOCK_SIZE, text.size());
+            blocks_.push_back(std::make_unique<char[]>(block_capacity_));
+            block_used_ = 0;
+        }
+        char* data = blocks_.back().get() + block_used_;
+        std::memcpy(data, text.data(), text.size());
+        block_used_ += text.size();
+        return {data, text.size()};
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_used_ = 0;
+    size_t block_capacity_ = 0;
+    std::unordered_set<std::string_view> strings_;
+};
+
+} // namespace transport::catalogue
@@ -0,0 +1,124 @@
+// Сравнивает ответы маршрутизатора на целых весах (сотые доли секунды) с ответами на минутах
+// во всех режимах и моделях графа. Сборка из каталога transport-catalogue:
+//     g++ -std=c++17 -O2 -pthread -I. $(ls *.cpp | grep -v main.cpp) tests/integer_weights_test.cpp
+// Возвращает ненулевой код при расхождении.
+
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace transport;
+
+namespace {
+
+// Ошибка округления — не больше половины сотой секунды на ребро пути
+constexpr double kTolerance = 1e-2;
+
+void FillCatalogue(catalogue::TransportCatalogue& catalogue, std::vector<std::string>& stop_names) {
+    std::mt19937 random(42);
+    constexpr int kStopCount = 40;
+    for (int i = 0; i < kStopCount; ++i) {
+        stop_names.push_back("Stop " + std::to_string(i));
+        catalogue.AddStop(stop_names.back(), 55.6 + 0.01 * (i % 7) + 0.001 * (random() % 5),
+                          37.5 + 0.01 * (i / 7) + 0.001 * (random() % 5));
+    }
+    for (int bus = 0; bus < 12; ++bus) {
+        std::vector<std::string_view> stops;
+        const size_t length = 3 + random() % 8;
+        for (size_t i = 0; i < length; ++i) {
+            stops.push_back(stop_names[random() % kStopCount]);
+        }
+        const bool is_circle = bus % 3 == 0;
+        if (is_circle) {
+            stops.push_back(stops.front());
+        }
+        catalogue.AddBus("Bus " + std::to_string(bus), stops, is_circle);
+    }
+    for (int i = 0; i < kStopCount; ++i) {
+        for (int j = 0; j < kStopCount; ++j) {
+            // Расстояния не кратны скорости, чтобы веса в минутах были дробными
+            catalogue.SetDistance(catalogue.FindStop(stop_names[i]), catalogue.FindStop(stop_names[j]),
+                                  i == j ? 0 : 1500 + static_cast<int>(random() % 3000));
+        }
+    }
+    catalogue.Finalize();
+}
+
+bool IsClose(double lhs, double rhs) {
+    return std::abs(lhs - rhs) <= kTolerance;
+}
+
+}  // namespace
+
+int main() {
+    catalogue::TransportCatalogue catalogue;
+    std::vector<std::string> stop_names;
+    FillCatalogue(catalogue, stop_names);
+    const std::vector<std::string_view> stops(stop_names.begin(), stop_names.end());
+
+    size_t mismatches = 0;
+    for (const auto mode : {graph::RouterMode::ALL_PAIRS, graph::RouterMode::ALL_PAIRS_COMPACT,
+                            graph::RouterMode::ON_DEMAND, graph::RouterMode::CONTRACTION_HIERARCHIES,
+                            graph::RouterMode::A_STAR, graph::RouterMode::BIDIRECTIONAL}) {
+        for (const auto model : {routing::GraphModel::STOP_PAIRS, routing::GraphModel::ROUTE_PATTERN}) {
+            routing::RoutingSettings settings;
+            settings.bus_wait_time = 6;
+            settings.bus_velocity = 37.0;
+            settings.router_mode = mode;
+            settings.graph_model = model;
+            const routing::TransportRouter minutes_router(catalogue, settings);
+            settings.weight_type = routing::WeightType::CENTISECONDS;
+            const routing::TransportRouter centiseconds_router(catalogue, settings);
+
+            auto report = [&](std::string_view from, std::string_view to, std::string_view what) {
+                ++mismatches;
+                std::cerr << "mode " << static_cast<int>(mode) << " model " << static_cast<int>(model)
+                          << ": " << what << " " << from << " -> " << to << '\n';
+            };
+            for (const auto from : stops) {
+                for (const auto to : stops) {
+                    const auto expected = minutes_router.BuildRoute(from, to);
+                    const auto actual = centiseconds_router.BuildRoute(from, to);
+                    if (expected.has_value() != actual.has_value()) {
+                        report(from, to, "reachability");
+                        continue;
+                    }
+                    if (!expected) {
+                        continue;
+                    }
+                    double items_time = 0.0;
+                    for (const auto& item : actual->items) {
+                        items_time += item.time;
+                    }
+                    if (!IsClose(expected->total_time, actual->total_time)
+                        || !IsClose(items_time, actual->total_time)) {
+                        report(from, to, "total_time");
+                    }
+                }
+            }
+
+            const auto expected_matrix = minutes_router.BuildTimeMatrix(stops, stops);
+            const auto actual_matrix = centiseconds_router.BuildTimeMatrix(stops, stops);
+            for (size_t i = 0; i < expected_matrix.size(); ++i) {
+                const auto& expected = expected_matrix[i];
+                const auto& actual = actual_matrix[i];
+                if (expected.has_value() != actual.has_value() || (expected && !IsClose(*expected, *actual))) {
+                    report(stops[i / stops.size()], stops[i % stops.size()], "time matrix");
+                }
+            }
+        }
+    }
+
+    if (mismatches > 0) {
+        std::cerr << mismatches << " mismatches\n";
+        return 1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
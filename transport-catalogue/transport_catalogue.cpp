@@ -1,8 +1,10 @@
 #include "transport_catalogue.h"
 #include "geo.h"
+#include "parallel.h"
 
-#include <unordered_set>
 #include <limits>
+#include <stdexcept>
+#include <utility>
 
 namespace transport::catalogue {
 
@@ -10,115 +12,288 @@ using std::deque;
 using std::string;
 using std::string_view;
 using std::unordered_map;
-using std::unordered_set;
 using std::vector;
 using std::optional;
-using std::set;
 
-void TransportCatalogue::AddStop(string name, double lat, double lon) {
-    if (FindStop(name)) return;
-    stops_.push_back(domain::Stop{ std::move(name), transport::geo::Coordinates{lat, lon} });
-    const domain::Stop& stop = stops_.back();
-    stops_index_[stop.name] = &stop;
+void TransportCatalogue::AddStop(string_view name, double lat, double lon) {
+    AddStop(name, transport::geo::Coordinates{lat, lon});
 }
 
-void TransportCatalogue::AddStop(string name, transport::geo::Coordinates coords) {
+void TransportCatalogue::AddStop(string_view name, transport::geo::Coordinates coords) {
     if (FindStop(name)) return;
-    stops_.push_back(domain::Stop{ std::move(name), coords });
+    const auto stop_id = static_cast<uint32_t>(stops_.size());
+    stops_.push_back(domain::Stop{ names_.Intern(name), coords, stop_id });
     const domain::Stop& stop = stops_.back();
     stops_index_[stop.name] = &stop;
+
+    stop_lats_.push_back(coords.lat);
+    stop_lngs_.push_back(coords.lng);
+    stop_names_ += stop.name;
+    stop_name_offsets_.push_back(static_cast<uint32_t>(stop_names_.size()));
+    if (is_finalized_) {
+        // У новой остановки ещё нет ни автобусов, ни расстояний
+        stop_bus_offsets_.push_back(stop_bus_offsets_.back());
+        distance_offsets_.push_back(distance_offsets_.back());
+    }
 }
 
-void TransportCatalogue::AddBus(string name, const vector<string>& stop_names, bool is_circle) {
+void TransportCatalogue::AddBus(string_view name, const vector<string_view>& stop_names, bool is_circle) {
     buses_.emplace_back();
     domain::Bus& bus = buses_.back();
-    bus.name = std::move(name);
+    bus.id = static_cast<uint32_t>(buses_.size() - 1);
+    bus.name = names_.Intern(name);
     bus.is_circle = is_circle;
 
     for (const auto& stop_name : stop_names) {
         const domain::Stop* stop = FindStop(stop_name);
         if (stop) {
             bus.stops.push_back(stop);
-            stop_to_bus_[string(stop->name)].insert(bus.name);
         }
     }
 
     bus_index_[bus.name] = &bus;
+    if (is_finalized_) {
+        bus_distances_.resize(buses_.size());
+        bus_infos_.resize(buses_.size());
+        ComputeBusStats(bus);
+        BuildStopBusIndex();
+    }
 }
 
-const domain::Stop* TransportCatalogue::FindStop(string_view name) const {
-    auto it = stops_index_.find(name);
-    return it != stops_index_.end() ? it->second : nullptr;
+void TransportCatalogue::Finalize() {
+    BuildDistanceIndex();
+    BuildStopBusIndex();
+    // Расстояния автобусов считаются уже по индексу расстояний
+    is_finalized_ = true;
+    // Каждый автобус пишет только в свои ячейки, поэтому автобусы считаются параллельно
+    const vector<const domain::Bus*> buses = GetAllBuses();
+    bus_distances_.assign(buses_.size(), {});
+    bus_infos_.assign(buses_.size(), std::nullopt);
+    parallel::ForEachIndex(buses.size(), [&](size_t index) {
+        ComputeBusStats(*buses[index]);
+    });
 }
 
-const domain::Bus* TransportCatalogue::FindBus(string_view name) const {
-    auto it = bus_index_.find(name);
-    return it != bus_index_.end() ? it->second : nullptr;
+void TransportCatalogue::CheckFinalized() const {
+    if (!is_finalized_) {
+        throw std::logic_error("Transport catalogue is not finalized");
+    }
 }
 
-optional<BusInfo> TransportCatalogue::GetBusInfo(string_view bus_name) const {
-    const domain::Bus* bus = FindBus(bus_name);
-    if (!bus || bus->stops.empty()) {
-        return std::nullopt;
+void TransportCatalogue::BuildStopBusIndex() {
+    // Автобусы раскладываются по остановкам в порядке имён, поэтому списки остановок
+    // получаются уже упорядоченными
+    vector<const domain::Bus*> buses = GetAllBuses();
+    std::sort(buses.begin(), buses.end(), [](const domain::Bus* lhs, const domain::Bus* rhs) {
+        return lhs->name < rhs->name;
+    });
+
+    // Автобус, последним записанный на остановку: повторные проходы через неё не дублируются
+    constexpr uint32_t NO_BUS = std::numeric_limits<uint32_t>::max();
+    vector<uint32_t> last_bus(stops_.size(), NO_BUS);
+    stop_bus_offsets_.assign(stops_.size() + 1, 0);
+    for (const auto* bus : buses) {
+        for (const auto* stop : bus->stops) {
+            if (last_bus[stop->id] != bus->id) {
+                last_bus[stop->id] = bus->id;
+                ++stop_bus_offsets_[stop->id + 1];
+            }
+        }
+    }
+    for (size_t stop = 0; stop < stops_.size(); ++stop) {
+        stop_bus_offsets_[stop + 1] += stop_bus_offsets_[stop];
+    }
+
+    stop_bus_ids_.resize(stop_bus_offsets_.back());
+    std::fill(last_bus.begin(), last_bus.end(), NO_BUS);
+    vector<uint32_t> positions(stop_bus_offsets_.begin(), stop_bus_offsets_.end() - 1);
+    for (const auto* bus : buses) {
+        for (const auto* stop : bus->stops) {
+            if (last_bus[stop->id] != bus->id) {
+                last_bus[stop->id] = bus->id;
+                stop_bus_ids_[positions[stop->id]++] = bus->id;
+            }
+        }
+    }
+}
+
+void TransportCatalogue::BuildDistanceIndex() {
+    // Явно заданные расстояния и обратные к ним, если обратные не заданы
+    vector<std::pair<uint32_t, RoadDistance>> entries;
+    entries.reserve(distances_.size() * 2);
+    for (const auto& [stops, distance] : distances_) {
+        const auto& [from, to] = stops;
+        entries.push_back({from->id, {to->id, distance}});
+        if (from != to && !distances_.count({to, from})) {
+            entries.push_back({to->id, {from->id, distance}});
+        }
+    }
+
+    distance_offsets_.assign(stops_.size() + 1, 0);
+    for (const auto& [from, road_distance] : entries) {
+        ++distance_offsets_[from + 1];
+    }
+    for (size_t stop = 0; stop < stops_.size(); ++stop) {
+        distance_offsets_[stop + 1] += distance_offsets_[stop];
+    }
+    road_distances_.resize(entries.size());
+    vector<uint32_t> positions(distance_offsets_.begin(), distance_offsets_.end() - 1);
+    for (const auto& [from, road_distance] : entries) {
+        road_distances_[positions[from]++] = road_distance;
+    }
+    for (size_t stop = 0; stop < stops_.size(); ++stop) {
+        std::sort(road_distances_.begin() + distance_offsets_[stop],
+                  road_distances_.begin() + distance_offsets_[stop + 1],
+                  [](const RoadDistance& lhs, const RoadDistance& rhs) { return lhs.to_stop < rhs.to_stop; });
+    }
+}
+
+const TransportCatalogue::RoadDistance* TransportCatalogue::FindRoadDistance(uint32_t from_stop,
+                                                                             uint32_t to_stop) const {
+    // У остановки обычно несколько соседей: двоичный поиск по короткому отрезку
+    const auto first = road_distances_.begin() + distance_offsets_[from_stop];
+    const auto last = road_distances_.begin() + distance_offsets_[from_stop + 1];
+    const auto it = std::lower_bound(first, last, to_stop, [](const RoadDistance& entry, uint32_t stop) {
+        return entry.to_stop < stop;
+    });
+    return it != last && it->to_stop == to_stop ? &*it : nullptr;
+}
+
+TransportCatalogue::RoadDistance* TransportCatalogue::FindRoadDistance(uint32_t from_stop, uint32_t to_stop) {
+    return const_cast<RoadDistance*>(std::as_const(*this).FindRoadDistance(from_stop, to_stop));
+}
+
+BusIdRange TransportCatalogue::GetStopBuses(uint32_t stop_id) const {
+    CheckFinalized();
+    return BusIdRange{stop_bus_ids_.begin() + stop_bus_offsets_[stop_id],
+                      stop_bus_ids_.begin() + stop_bus_offsets_[stop_id + 1]};
+}
+
+void TransportCatalogue::ComputeBusStats(const domain::Bus& bus) {
+    const auto& stops = bus.stops;
+    BusDistances& distances = bus_distances_[bus.id];
+    distances.forward_road.assign(stops.size(), 0);
+    distances.backward_road.assign(stops.size(), 0);
+    distances.geo.assign(stops.size(), 0.0);
+    for (size_t i = 1; i < stops.size(); ++i) {
+        distances.forward_road[i] = distances.forward_road[i - 1] + GetDistance(stops[i - 1], stops[i]);
+        distances.backward_road[i] = distances.backward_road[i - 1] + GetDistance(stops[i], stops[i - 1]);
+        distances.geo[i] = distances.geo[i - 1]
+            + transport::geo::ComputeDistance(stops[i - 1]->coordinates, stops[i]->coordinates);
     }
 
-    BusInfo info;
-    const auto& stops = bus->stops;
+    auto& info = bus_infos_[bus.id];
+    if (stops.empty()) {
+        info.reset();
+        return;
+    }
+    info.emplace();
 
-    unordered_set<const domain::Stop*> unique_stops(stops.begin(), stops.end());
-    info.unique_stops = unique_stops.size();
+    // Номера остановок плотные: уникальные считаем сортировкой, без хеширования
+    vector<uint32_t> stop_ids;
+    stop_ids.reserve(stops.size());
+    for (const auto* stop : stops) {
+        stop_ids.push_back(stop->id);
+    }
+    std::sort(stop_ids.begin(), stop_ids.end());
+    info->unique_stops = std::unique(stop_ids.begin(), stop_ids.end()) - stop_ids.begin();
 
-    int road_length = 0;
-    double geo_length = 0.0;
+    int road_length = distances.forward_road.back();
+    double geo_length = distances.geo.back();
 
-    if (bus->is_circle) {
+    if (bus.is_circle) {
         // кольцо
-        info.total_stops = stops.size();
-        
-        for (size_t i = 1; i < stops.size(); ++i) {
-            road_length += GetDistance(stops[i-1], stops[i]);
-            geo_length += transport::geo::ComputeDistance(stops[i-1]->coordinates, stops[i]->coordinates);
-        }
+        info->total_stops = stops.size();
     } else {
-        // не кольцо
-        info.total_stops = 2 * stops.size() - 1;
-        
-        // туда
-        for (size_t i = 1; i < stops.size(); ++i) {
-            road_length += GetDistance(stops[i-1], stops[i]);
-            geo_length += transport::geo::ComputeDistance(stops[i-1]->coordinates, stops[i]->coordinates);
-        }
-        // обратно
-        for (size_t i = stops.size() - 1; i > 0; --i) {
-            road_length += GetDistance(stops[i], stops[i-1]);
-            geo_length += transport::geo::ComputeDistance(stops[i]->coordinates, stops[i-1]->coordinates);
-        }
+        // не кольцо: туда и обратно
+        info->total_stops = 2 * stops.size() - 1;
+        road_length += distances.backward_road.back();
+        geo_length *= 2;
     }
 
-    info.length = road_length;
-    info.curvature = (geo_length == 0.0) ? 1.0 : static_cast<double>(road_length) / geo_length;
-    return info;
+    info->length = road_length;
+    info->curvature = (geo_length == 0.0) ? 1.0 : static_cast<double>(road_length) / geo_length;
 }
 
-optional<const set<string>*> TransportCatalogue::GetBusesByStop(string_view stop_name) const {
-    if (!FindStop(stop_name)) {
-        return std::nullopt;
+const BusDistances& TransportCatalogue::GetBusDistances(const domain::Bus* bus) const {
+    CheckFinalized();
+    return bus_distances_.at(bus->id);
+}
+
+bool TransportCatalogue::RemoveBus(string_view name) {
+    auto it = bus_index_.find(name);
+    if (it == bus_index_.end()) {
+        return false;
+    }
+    const domain::Bus* bus = it->second;
+    bus_index_.erase(it);
+    if (is_finalized_) {
+        bus_distances_[bus->id] = {};
+        bus_infos_[bus->id].reset();
+        BuildStopBusIndex();
     }
+    return true;
+}
+
+const domain::Stop* TransportCatalogue::FindStop(string_view name) const {
+    auto it = stops_index_.find(name);
+    return it != stops_index_.end() ? it->second : nullptr;
+}
+
+const domain::Bus* TransportCatalogue::FindBus(string_view name) const {
+    auto it = bus_index_.find(name);
+    return it != bus_index_.end() ? it->second : nullptr;
+}
 
-    auto it = stop_to_bus_.find(string(stop_name));
-    if (it == stop_to_bus_.end()) {
-        static const std::set<std::string> empty_set;
-        return &empty_set;
+optional<BusInfo> TransportCatalogue::GetBusInfo(string_view bus_name) const {
+    const domain::Bus* bus = FindBus(bus_name);
+    if (!bus) {
+        return std::nullopt;
     }
+    CheckFinalized();
+    return bus_infos_[bus->id];
+}
 
-    return &it->second;
+optional<BusIdRange> TransportCatalogue::GetBusesByStop(string_view stop_name) const {
+    const domain::Stop* stop = FindStop(stop_name);
+    if (!stop) {
+        return std::nullopt;
+    }
+    return GetStopBuses(stop->id);
 }
 
 void TransportCatalogue::SetDistance(const domain::Stop* from, const domain::Stop* to, int distance) {
     distances_[{from, to}] = distance;
+    if (is_finalized_) {
+        // Новый перегон меняет состав отрезков, известный — правится на месте
+        RoadDistance* forward = FindRoadDistance(from->id, to->id);
+        RoadDistance* backward = FindRoadDistance(to->id, from->id);
+        if (!forward || !backward) {
+            BuildDistanceIndex();
+        } else {
+            forward->distance = distance;
+            if (!distances_.count({to, from})) {
+                backward->distance = distance;
+            }
+        }
+    }
+
+    // До Finalize расстояния автобусов ещё не считались. Перегон в обе стороны проходит
+    // только через автобусы остановки from.
+    if (is_finalized_) {
+        for (const uint32_t bus_id : GetStopBuses(from->id)) {
+            ComputeBusStats(buses_[bus_id]);
+        }
+    }
 }
 
 int TransportCatalogue::GetDistance(const domain::Stop* from, const domain::Stop* to) const {
+    if (is_finalized_) {
+        if (const RoadDistance* road_distance = FindRoadDistance(from->id, to->id)) {
+            return road_distance->distance;
+        }
+        return transport::geo::ComputeDistance(from->coordinates, to->coordinates);
+    }
 
     auto it = distances_.find({ from, to });
     if (it != distances_.end()) {
@@ -136,7 +311,10 @@ int TransportCatalogue::GetDistance(const domain::Stop* from, const domain::Stop
 std::vector<const domain::Bus*> TransportCatalogue::GetAllBuses() const {
     std::vector<const domain::Bus*> result;
     for (const auto& bus : buses_) {
-        result.push_back(&bus);
+        // Удалённые и перекрытые одноимёнными автобусы в индексе уже не значатся
+        if (FindBus(bus.name) == &bus) {
+            result.push_back(&bus);
+        }
     }
     return result;
 }
@@ -150,14 +328,25 @@ std::vector<const domain::Stop*> TransportCatalogue::GetAllStops() const {
 }
 
 std::vector<const domain::Stop*> TransportCatalogue::GetStopsUsedInRoutes() const {
+    CheckFinalized();
     std::vector<const domain::Stop*> result;
     for (const auto& stop : stops_) {
-        auto it = stop_to_bus_.find(stop.name);
-        if (it != stop_to_bus_.end() && !it->second.empty()) {
+        if (stop_bus_offsets_[stop.id] != stop_bus_offsets_[stop.id + 1]) {
             result.push_back(&stop);
         }
     }
     return result;
 }
 
+std::vector<uint32_t> TransportCatalogue::GetStopIdsUsedInRoutes() const {
+    CheckFinalized();
+    std::vector<uint32_t> result;
+    for (uint32_t stop_id = 0; stop_id < stops_.size(); ++stop_id) {
+        if (stop_bus_offsets_[stop_id] != stop_bus_offsets_[stop_id + 1]) {
+            result.push_back(stop_id);
+        }
+    }
+    return result;
+}
+
 } // namespace transport::catalogue
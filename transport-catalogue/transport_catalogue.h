@@ -1,14 +1,16 @@
 #pragma once
 
 #include "domain.h"
+#include "ranges.h"
+#include "string_arena.h"
 
+#include <cstdint>
 #include <deque>
 #include <vector>
 #include <unordered_map>
 #include <string_view>
 #include <string>
 #include <optional>
-#include <set>
 #include <functional>
 #include <algorithm>
 
@@ -21,6 +23,17 @@ struct BusInfo {
     double curvature = 0.0;
 };
 
+// Расстояния вдоль маршрута нарастающим итогом: отрезок между позициями i < j — разность
+// элементов j и i, без обращений к таблице расстояний
+struct BusDistances {
+    std::vector<int> forward_road;   // [i] — по дорогам от stops[0] до stops[i]
+    std::vector<int> backward_road;  // [i] — по дорогам обратно от stops[i] до stops[0]
+    std::vector<double> geo;         // [i] — по сфере от stops[0] до stops[i]
+};
+
+// Номера автобусов, проходящих через остановку, по возрастанию имён автобусов
+using BusIdRange = ranges::Range<std::vector<uint32_t>::const_iterator>;
+
 struct StopPairHash {
     size_t operator()(const std::pair<const domain::Stop*, const domain::Stop*>& p) const {
         auto h1 = std::hash<const void*>{}(static_cast<const void*>(p.first));
@@ -31,33 +44,111 @@ struct StopPairHash {
 
 class TransportCatalogue {
 public:
-    void AddStop(std::string name, double lat, double lon);
-    void AddStop(std::string name, transport::geo::Coordinates coords);
-    void AddBus(std::string name, const std::vector<std::string>& stop_names, bool is_circle);
+    // Имена копируются в арену справочника: переданные строки можно не хранить
+    void AddStop(std::string_view name, double lat, double lon);
+    void AddStop(std::string_view name, transport::geo::Coordinates coords);
+    void AddBus(std::string_view name, const std::vector<std::string_view>& stop_names, bool is_circle);
+    // Автобус перестаёт находиться и перечисляться; указатели на него остаются валидными
+    bool RemoveBus(std::string_view name);
+    // Завершает загрузку: строит индексы автобусов и расстояний по остановкам и считает
+    // расстояния вдоль маршрутов. Запросы по остановкам и расстояния автобусов доступны
+    // только после него; изменения после Finalize обновляют их сразу.
+    void Finalize();
+    bool IsFinalized() const {
+        return is_finalized_;
+    }
 
     const domain::Stop* FindStop(std::string_view name) const;
     const domain::Bus* FindBus(std::string_view name) const;
 
+    // Сводка по автобусу, посчитанная заранее в Finalize
     std::optional<BusInfo> GetBusInfo(std::string_view bus_name) const;
-    std::optional<const std::set<std::string>*> GetBusesByStop(std::string_view stop_name) const;
+    std::optional<BusIdRange> GetBusesByStop(std::string_view stop_name) const;
+    BusIdRange GetStopBuses(uint32_t stop_id) const;
 
     void SetDistance(const domain::Stop* from, const domain::Stop* to, int distance);
     int GetDistance(const domain::Stop* from, const domain::Stop* to) const;
+    // Считается в Finalize и обновляется в SetDistance для автобусов через изменённый перегон
+    const BusDistances& GetBusDistances(const domain::Bus* bus) const;
 
     std::vector<const domain::Bus*> GetAllBuses() const;
     std::vector<const domain::Stop*> GetAllStops() const;
     std::vector<const domain::Stop*> GetStopsUsedInRoutes() const;
+    // Номера остановок, через которые проходит хотя бы один автобус, по возрастанию
+    std::vector<uint32_t> GetStopIdsUsedInRoutes() const;
+
+    // Доступ по номеру: остановки нумеруются 0..GetStopCount()-1, автобусы — 0..GetBusCount()-1,
+    // включая удалённые
+    size_t GetStopCount() const {
+        return stops_.size();
+    }
+    size_t GetBusCount() const {
+        return buses_.size();
+    }
+    const domain::Stop& GetStop(uint32_t stop_id) const {
+        return stops_.at(stop_id);
+    }
+    const domain::Bus& GetBus(uint32_t bus_id) const {
+        return buses_.at(bus_id);
+    }
+
+    // Остановки по столбцам, индекс — номер остановки
+    const std::vector<double>& GetStopLatitudes() const {
+        return stop_lats_;
+    }
+    const std::vector<double>& GetStopLongitudes() const {
+        return stop_lngs_;
+    }
+    std::string_view GetStopName(uint32_t stop_id) const {
+        const uint32_t begin = stop_name_offsets_.at(stop_id);
+        return std::string_view(stop_names_).substr(begin, stop_name_offsets_[stop_id + 1] - begin);
+    }
 
 private:
+    // Имена остановок и автобусов; Stop::name и Bus::name ссылаются сюда
+    StringArena names_;
+
     std::deque<domain::Stop> stops_{};
+    // Столбцы остановок; имя остановки s — [stop_name_offsets_[s], stop_name_offsets_[s + 1])
+    // в stop_names_, имена всех остановок идут подряд
+    std::vector<double> stop_lats_;
+    std::vector<double> stop_lngs_;
+    std::string stop_names_;
+    std::vector<uint32_t> stop_name_offsets_{0};
     std::unordered_map<std::string_view, const domain::Stop*> stops_index_{};
 
     std::deque<domain::Bus> buses_{};
     std::unordered_map<std::string_view, const domain::Bus*> bus_index_{};
 
-    std::unordered_map<std::string, std::set<std::string>> stop_to_bus_;
+    // Автобусы остановок в CSR: номера автобусов остановки s лежат
+    // в [stop_bus_offsets_[s], stop_bus_offsets_[s + 1]) по возрастанию имён
+    std::vector<uint32_t> stop_bus_offsets_;
+    std::vector<uint32_t> stop_bus_ids_;
+    bool is_finalized_ = false;
 
+    // Расстояния в том виде, в каком их задали; до Finalize GetDistance ищет здесь
     std::unordered_map<std::pair<const domain::Stop*, const domain::Stop*>, int, StopPairHash> distances_;
+
+    // Расстояние по дорогам до соседней остановки
+    struct RoadDistance {
+        uint32_t to_stop;
+        int distance;
+    };
+    // Расстояния по остановкам в CSR: из остановки s — [distance_offsets_[s], distance_offsets_[s + 1])
+    // по возрастанию to_stop. Обратное расстояние, не заданное явно, уже подставлено.
+    std::vector<uint32_t> distance_offsets_;
+    std::vector<RoadDistance> road_distances_;
+    // Расстояния вдоль маршрутов и сводки автобусов по номеру автобуса; считаются в Finalize
+    // и пересчитываются при изменениях. Сводки нет у автобуса без остановок и у удалённого.
+    std::vector<BusDistances> bus_distances_;
+    std::vector<std::optional<BusInfo>> bus_infos_;
+
+    void CheckFinalized() const;
+    void BuildStopBusIndex();
+    void BuildDistanceIndex();
+    RoadDistance* FindRoadDistance(uint32_t from_stop, uint32_t to_stop);
+    const RoadDistance* FindRoadDistance(uint32_t from_stop, uint32_t to_stop) const;
+    void ComputeBusStats(const domain::Bus& bus);
 };
 
 } // namespace transport::catalogue
\ No newline at end of file
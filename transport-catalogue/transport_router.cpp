@@ -1,6 +1,13 @@
 #include "transport_router.h"
+#include "geo.h"
+
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
 #include <stdexcept>
+#include <type_traits>
 
 namespace transport::routing {
 
@@ -14,6 +21,31 @@ namespace {
     inline graph::VertexId OutVertexId(size_t stop_index) {
         return stop_index * kVerticesPerStop + 1;
     }
+
+    // Заголовок файла с состоянием маршрутизатора; версия меняется вместе с форматом
+    constexpr char kCacheMagic[4] = {'T', 'C', 'R', 'T'};
+    constexpr uint32_t kCacheVersion = 8;
+
+    constexpr double kCentisecondsPerMinute = 6000.0;
+
+    // Время в минутах в единицах веса графа: целые веса — сотые доли секунды
+    template <typename Weight>
+    Weight ToWeight(double minutes) {
+        if constexpr (std::is_integral_v<Weight>) {
+            return static_cast<Weight>(std::llround(minutes * kCentisecondsPerMinute));
+        } else {
+            return minutes;
+        }
+    }
+
+    template <typename Weight>
+    double ToMinutes(Weight weight) {
+        if constexpr (std::is_integral_v<Weight>) {
+            return weight / kCentisecondsPerMinute;
+        } else {
+            return weight;
+        }
+    }
 }
 
 TransportRouter::TransportRouter(
@@ -22,103 +54,674 @@ TransportRouter::TransportRouter(
     : catalogue_(catalogue)
     , settings_(settings)
 {
+    Build();
+}
+
+void TransportRouter::Build() {
+    if (settings_.weight_type == WeightType::CENTISECONDS) {
+        routing_.emplace<GraphRouting<int64_t>>();
+    } else {
+        routing_.emplace<GraphRouting<double>>();
+    }
+    edge_info_.clear();
+    ride_vertex_stops_.clear();
+
     stop_id_to_stop_ = catalogue_.GetStopsUsedInRoutes();
     const size_t stop_count = stop_id_to_stop_.size();
-    
+
+    stop_catalogue_ids_.resize(stop_count);
+    stop_indices_.assign(catalogue_.GetStopCount(), NO_STOP);
     for (size_t i = 0; i < stop_count; ++i) {
-        stop_name_to_id_[stop_id_to_stop_[i]->name] = i;
+        stop_catalogue_ids_[i] = stop_id_to_stop_[i]->id;
+        stop_indices_[stop_catalogue_ids_[i]] = static_cast<uint32_t>(i);
+    }
+    bus_id_to_bus_.assign(catalogue_.GetBusCount(), nullptr);
+    for (const auto* bus : catalogue_.GetAllBuses()) {
+        bus_id_to_bus_[bus->id] = bus;
+    }
+
+    {
+        std::lock_guard guard(raptor_mutex_);
+        raptor_.reset();
+    }
+    if (settings_.routing_engine == RoutingEngine::RAPTOR) {
+        GetRaptor();
+        return;
+    }
+
+    if (settings_.cache_file.empty() || !LoadFromFile(settings_.cache_file)) {
+        std::visit([this](auto& routing) {
+            using Weight = typename std::decay_t<decltype(routing)>::Weight;
+            BuildGraph(routing.graph);
+            routing.graph.Freeze();
+            routing.router = std::make_unique<graph::Router<Weight>>(routing.graph, settings_.router_mode);
+            if (settings_.router_mode == graph::RouterMode::A_STAR) {
+                routing.router->BuildLandmarks(GetStopVertices(), settings_.landmark_count);
+            }
+        }, routing_);
+        if (!settings_.cache_file.empty()) {
+            SaveToFile(settings_.cache_file);
+        }
+    }
+    IndexBusEdges();
+    std::visit([this](auto& routing) {
+        routing.router->SetTreeCacheBudget(settings_.tree_cache_budget);
+    }, routing_);
+    if (settings_.router_mode == graph::RouterMode::A_STAR) {
+        SetupGeoPotential();
+    }
+}
+
+uint64_t TransportRouter::ComputeInputChecksum() const {
+    serialization::Checksum checksum;
+    checksum.AddPod(settings_.bus_wait_time);
+    checksum.AddPod(settings_.bus_velocity);
+    checksum.AddPod(settings_.router_mode);
+    checksum.AddPod(settings_.graph_model);
+    checksum.AddPod<uint64_t>(settings_.landmark_count);
+    checksum.AddPod(settings_.weight_type);
+    checksum.AddPod<uint64_t>(settings_.weight_type == WeightType::CENTISECONDS ? sizeof(int64_t) : sizeof(double));
+    checksum.AddPod<uint64_t>(sizeof(graph::EdgeId));
+
+    for (const auto* stop : stop_id_to_stop_) {
+        checksum.Add(stop->name);
+        checksum.AddPod(stop->coordinates.lat);
+        checksum.AddPod(stop->coordinates.lng);
     }
+    checksum.AddPod<uint64_t>(catalogue_.GetBusCount());
+    for (const auto* bus : catalogue_.GetAllBuses()) {
+        checksum.AddPod(bus->id);
+        checksum.Add(bus->name);
+        checksum.AddPod(bus->is_circle);
+        checksum.AddPod<uint64_t>(bus->stops.size());
+        for (size_t i = 0; i < bus->stops.size(); ++i) {
+            checksum.Add(bus->stops[i]->name);
+            if (i > 0) {
+                checksum.AddPod(catalogue_.GetDistance(bus->stops[i - 1], bus->stops[i]));
+                checksum.AddPod(catalogue_.GetDistance(bus->stops[i], bus->stops[i - 1]));
+            }
+        }
+    }
+    return checksum.Get();
+}
+
+bool TransportRouter::SaveToFile(const std::string& path) const {
+    // Пишем во временный файл и переименовываем, чтобы читатели не увидели его недописанным
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        serialization::Writer writer(out);
+        writer.WriteBytes(kCacheMagic, sizeof(kCacheMagic));
+        writer.WritePod(kCacheVersion);
+        writer.WritePod(ComputeInputChecksum());
+
+        std::visit([this, &writer](const auto& routing) {
+            using Weight = typename std::decay_t<decltype(routing)>::Weight;
+            writer.WritePod<uint64_t>(routing.graph.GetVertexCount());
+            std::vector<graph::Edge<Weight>> edges;
+            edges.reserve(routing.graph.GetEdgeCount());
+            for (graph::EdgeId edge_id = 0; edge_id < routing.graph.GetEdgeCount(); ++edge_id) {
+                edges.push_back(routing.graph.GetEdge(edge_id));
+            }
+            writer.WriteVector(edges);
+
+            writer.WriteVector(ride_vertex_stops_);
+            writer.WriteVector(edge_info_);
 
-    graph_ = graph::DirectedWeightedGraph<double>(stop_count * kVerticesPerStop);
-    BuildGraph();
-    router_ = std::make_unique<graph::Router<double>>(graph_);
+            routing.router->SaveState(writer);
+        }, routing_);
+        // Контрольная сумма всего файла: испорченные веса и номера не пройдут проверку при загрузке
+        const uint64_t file_checksum = writer.GetChecksum();
+        writer.WritePod(file_checksum);
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+bool TransportRouter::LoadFromFile(const std::string& path) {
+    if (!std::ifstream(path)) {
+        return false;
+    }
+    try {
+        serialization::Reader reader(std::make_shared<const serialization::MappedFile>(path));
+        reader.CheckTrailingChecksum();
+        char magic[sizeof(kCacheMagic)];
+        reader.ReadBytes(magic, sizeof(magic));
+        if (!std::equal(std::begin(magic), std::end(magic), std::begin(kCacheMagic))
+            || reader.ReadPod<uint32_t>() != kCacheVersion
+            || reader.ReadPod<uint64_t>() != ComputeInputChecksum()) {
+            return false;
+        }
+
+        std::visit([this, &reader](auto& routing) {
+            using Weight = typename std::decay_t<decltype(routing)>::Weight;
+            const size_t stop_count = stop_id_to_stop_.size();
+            const auto vertex_count = reader.ReadPod<uint64_t>();
+            routing.graph = graph::DirectedWeightedGraph<Weight>(vertex_count);
+            for (const auto& edge : reader.ReadVector<graph::Edge<Weight>>()) {
+                if (edge.from >= vertex_count || edge.to >= vertex_count) {
+                    throw serialization::FormatError("Edge vertex is out of range");
+                }
+                if (!(edge.weight >= Weight{})) {
+                    throw serialization::FormatError("Edge weight is out of range");
+                }
+                routing.graph.AddEdge(edge);
+            }
+            routing.graph.Freeze();
+
+            ride_vertex_stops_ = reader.ReadVector<uint32_t>();
+            const size_t expected_vertex_count = settings_.graph_model == GraphModel::ROUTE_PATTERN
+                ? stop_count + ride_vertex_stops_.size()
+                : stop_count * kVerticesPerStop;
+            if (vertex_count != expected_vertex_count
+                || std::any_of(ride_vertex_stops_.begin(), ride_vertex_stops_.end(),
+                               [stop_count](uint32_t stop) { return stop >= stop_count; })) {
+                throw serialization::FormatError("Vertex layout mismatch");
+            }
+
+            edge_info_ = reader.ReadVector<EdgeInfo>();
+            if (edge_info_.size() != routing.graph.GetEdgeCount()) {
+                throw serialization::FormatError("Edge metadata size mismatch");
+            }
+            for (const auto& info : edge_info_) {
+                if (info.type > EdgeType::ALIGHT || info.stop_id >= stop_count
+                    || (info.bus_id != NO_BUS
+                        && (info.bus_id >= bus_id_to_bus_.size() || !bus_id_to_bus_[info.bus_id]))) {
+                    throw serialization::FormatError("Edge metadata is out of range");
+                }
+            }
+
+            routing.router = std::make_unique<graph::Router<Weight>>(routing.graph, settings_.router_mode, reader);
+        }, routing_);
+    } catch (const serialization::FormatError&) {
+        // Повреждённый файл просто пересобираем
+        edge_info_.clear();
+        ride_vertex_stops_.clear();
+        std::visit([](auto& routing) {
+            routing.router.reset();
+        }, routing_);
+        return false;
+    }
+    return true;
+}
+
+void TransportRouter::SetupGeoPotential() {
+    std::visit([this](auto& routing) {
+        using Weight = typename std::decay_t<decltype(routing)>::Weight;
+        // Дорожное расстояние может оказаться короче расстояния по сфере, поэтому масштабируем
+        // оценку на наименьшее отношение «вес ребра / расстояние по сфере» по всем поездкам графа.
+        // Отношение берётся от весов в единицах графа, уже округлённых, — так оценка остаётся
+        // допустимой и согласованной и для целых весов
+        double min_time_per_geo_meter = ComputeTravelTime(1);
+        for (graph::EdgeId edge_id = 0; edge_id < edge_info_.size(); ++edge_id) {
+            const auto& info = edge_info_[edge_id];
+            if (info.type != EdgeType::BUS || routing.graph.IsEdgeRemoved(edge_id)) {
+                continue;
+            }
+            const auto edge = routing.graph.GetEdge(edge_id);
+            const double geo_distance = ComputeGeoDistance(info.stop_id, GetVertexStop(edge.to));
+            if (geo_distance > 0.0) {
+                min_time_per_geo_meter = std::min(min_time_per_geo_meter, ToMinutes(edge.weight) / geo_distance);
+            }
+        }
+        min_time_per_geo_meter_ = std::max(min_time_per_geo_meter, 0.0);
+
+        routing.router->SetPotential([this](graph::VertexId vertex, graph::VertexId target) {
+            const size_t stop = GetVertexStop(vertex);
+            const size_t target_stop = GetVertexStop(target);
+            if (stop == target_stop) {
+                return Weight{};
+            }
+            const double wait_time = IsBoardingVertex(vertex) ? settings_.bus_wait_time : 0.0;
+            double lower_bound = ComputeLowerBoundTime(stop, target_stop);
+            if constexpr (std::is_integral_v<Weight>) {
+                // Округляем вниз: разность оценок концов ребра не превзойдёт его целый вес
+                lower_bound = std::floor(lower_bound * kCentisecondsPerMinute) / kCentisecondsPerMinute;
+            }
+            return ToWeight<Weight>(wait_time) + ToWeight<Weight>(lower_bound);
+        });
+    }, routing_);
+}
+
+double TransportRouter::ComputeGeoDistance(size_t from_stop, size_t to_stop) const {
+    const auto& lats = catalogue_.GetStopLatitudes();
+    const auto& lngs = catalogue_.GetStopLongitudes();
+    const uint32_t from = stop_catalogue_ids_[from_stop];
+    const uint32_t to = stop_catalogue_ids_[to_stop];
+    return geo::ComputeDistance({lats[from], lngs[from]}, {lats[to], lngs[to]});
+}
+
+double TransportRouter::ComputeLowerBoundTime(size_t from_stop, size_t to_stop) const {
+    return ComputeGeoDistance(from_stop, to_stop) * min_time_per_geo_meter_;
+}
+
+graph::TreeCacheStats TransportRouter::GetTreeCacheStats() const {
+    return std::visit([](const auto& routing) {
+        return routing.router ? routing.router->GetTreeCacheStats() : graph::TreeCacheStats{};
+    }, routing_);
 }
 
 double TransportRouter::ComputeTravelTime(int distance_meters) const {
     return distance_meters / ((settings_.bus_velocity * 1000.0) / 60.0);
 }
 
-void TransportRouter::BuildGraph() {
+uint32_t TransportRouter::GetStopIndex(const domain::Stop& stop) const {
+    return stop.id < stop_indices_.size() ? stop_indices_[stop.id] : NO_STOP;
+}
+
+std::optional<size_t> TransportRouter::FindStopIndex(std::string_view stop_name) const {
+    const auto* stop = catalogue_.FindStop(stop_name);
+    if (!stop) {
+        return std::nullopt;
+    }
+    const uint32_t index = GetStopIndex(*stop);
+    if (index == NO_STOP) {
+        return std::nullopt;
+    }
+    return index;
+}
+
+graph::VertexId TransportRouter::GetStopVertex(size_t stop_index) const {
+    return settings_.graph_model == GraphModel::ROUTE_PATTERN ? stop_index : InVertexId(stop_index);
+}
+
+std::vector<graph::VertexId> TransportRouter::GetStopVertices() const {
+    std::vector<graph::VertexId> vertices(stop_id_to_stop_.size());
+    for (size_t stop = 0; stop < vertices.size(); ++stop) {
+        vertices[stop] = GetStopVertex(stop);
+    }
+    return vertices;
+}
+
+size_t TransportRouter::GetVertexStop(graph::VertexId vertex) const {
+    if (settings_.graph_model == GraphModel::ROUTE_PATTERN) {
+        const size_t stop_count = stop_id_to_stop_.size();
+        return vertex < stop_count ? vertex : ride_vertex_stops_[vertex - stop_count];
+    }
+    return vertex / kVerticesPerStop;
+}
+
+bool TransportRouter::IsBoardingVertex(graph::VertexId vertex) const {
+    if (settings_.graph_model == GraphModel::ROUTE_PATTERN) {
+        return vertex < stop_id_to_stop_.size();
+    }
+    return vertex % kVerticesPerStop == 0;
+}
+
+template <typename Weight>
+void TransportRouter::BuildGraph(graph::DirectedWeightedGraph<Weight>& graph) {
+    if (settings_.graph_model == GraphModel::ROUTE_PATTERN) {
+        BuildRoutePatternGraph(graph);
+    } else {
+        BuildStopPairGraph(graph);
+    }
+}
+
+template <typename Weight>
+graph::EdgeId TransportRouter::AddGraphEdge(graph::DirectedWeightedGraph<Weight>& graph,
+                                            const graph::Edge<double>& edge, const EdgeInfo& info) {
+    const graph::EdgeId edge_id = graph.AddEdge({edge.from, edge.to, ToWeight<Weight>(edge.weight)});
+    edge_info_.push_back(info);
+    return edge_id;
+}
+
+template <typename Callback>
+void TransportRouter::ForEachBusEdge(uint32_t bus_id, graph::VertexId first_ride_vertex,
+                                     Callback&& callback) const {
+    const domain::Bus& bus = *bus_id_to_bus_[bus_id];
+    const auto& stops = bus.stops;
+    const size_t n = stops.size();
+    const auto& distances = catalogue_.GetBusDistances(&bus);
+
+    if (settings_.graph_model == GraphModel::ROUTE_PATTERN) {
+        if (n < 2) return;
+        const double wait_time = static_cast<double>(settings_.bus_wait_time);
+        graph::VertexId ride_vertex = first_ride_vertex;
+        // Посадка несёт ожидание, перегон — время в пути, высадка бесплатна
+        auto add_pattern = [&](bool is_backward) {
+            for (size_t position = 0; position < n; ++position, ++ride_vertex) {
+                const size_t i = is_backward ? n - 1 - position : position;
+                const size_t stop = GetStopIndex(*stops[i]);
+                const auto stop_id = static_cast<uint32_t>(stop);
+                if (position + 1 < n) {
+                    const int distance = is_backward
+                        ? distances.backward_road[i] - distances.backward_road[i - 1]
+                        : distances.forward_road[i + 1] - distances.forward_road[i];
+                    callback(graph::Edge<double>{stop, ride_vertex, wait_time},
+                             EdgeInfo{EdgeType::WAIT, bus_id, stop_id, 0});
+                    callback(graph::Edge<double>{ride_vertex, ride_vertex + 1, ComputeTravelTime(distance)},
+                             EdgeInfo{EdgeType::BUS, bus_id, stop_id, 1});
+                }
+                if (position > 0) {
+                    callback(graph::Edge<double>{ride_vertex, stop, 0.0},
+                             EdgeInfo{EdgeType::ALIGHT, bus_id, stop_id, 0});
+                }
+            }
+        };
+        add_pattern(false);
+        if (!bus.is_circle) {
+            add_pattern(true);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        const size_t from_idx = GetStopIndex(*stops[i]);
+        if (from_idx == NO_STOP) continue;
+
+        for (size_t j = i + 1; j < n; ++j) {
+            const size_t to_idx = GetStopIndex(*stops[j]);
+            if (to_idx == NO_STOP) continue;
+
+            double weight = ComputeTravelTime(distances.forward_road[j] - distances.forward_road[i]);
+            callback(graph::Edge<double>{OutVertexId(from_idx), InVertexId(to_idx), weight},
+                     EdgeInfo{EdgeType::BUS, bus_id, static_cast<uint32_t>(from_idx),
+                              static_cast<uint32_t>(j - i)});
+
+            if (!bus.is_circle) {
+                double rev_weight = ComputeTravelTime(distances.backward_road[j] - distances.backward_road[i]);
+                callback(graph::Edge<double>{OutVertexId(to_idx), InVertexId(from_idx), rev_weight},
+                         EdgeInfo{EdgeType::BUS, bus_id, static_cast<uint32_t>(to_idx),
+                                  static_cast<uint32_t>(j - i)});
+            }
+        }
+    }
+}
+
+size_t TransportRouter::AppendRideVertexStops(const domain::Bus& bus) {
+    const auto& stops = bus.stops;
+    if (stops.size() < 2) {
+        return 0;
+    }
+    // Проход в одном направлении; некольцевой маршрут даёт два независимых прохода,
+    // чтобы, как и в STOP_PAIRS, нельзя было проехать через конечную без пересадки
+    for (const auto* stop : stops) {
+        ride_vertex_stops_.push_back(GetStopIndex(*stop));
+    }
+    if (!bus.is_circle) {
+        for (auto it = stops.rbegin(); it != stops.rend(); ++it) {
+            ride_vertex_stops_.push_back(GetStopIndex(**it));
+        }
+    }
+    return bus.is_circle ? stops.size() : 2 * stops.size();
+}
+
+template <typename Weight>
+void TransportRouter::BuildStopPairGraph(graph::DirectedWeightedGraph<Weight>& graph) {
     const size_t stop_count = stop_id_to_stop_.size();
     const double wait_time = static_cast<double>(settings_.bus_wait_time);
+    graph = graph::DirectedWeightedGraph<Weight>(stop_count * kVerticesPerStop);
 
     // Ожидание для отсановок
     for (size_t i = 0; i < stop_count; ++i) {
-        graph::Edge<double> wait_edge{InVertexId(i), OutVertexId(i), wait_time};
-        graph_.AddEdge(wait_edge);
-        edge_info_.push_back({
-            "", 0,
-            std::string(stop_id_to_stop_[i]->name),
-            std::string(stop_id_to_stop_[i]->name)
+        AddGraphEdge(graph, {InVertexId(i), OutVertexId(i), wait_time},
+                     {EdgeType::WAIT, NO_BUS, static_cast<uint32_t>(i), 0});
+    }
+
+    for (uint32_t bus_id = 0; bus_id < bus_id_to_bus_.size(); ++bus_id) {
+        if (!bus_id_to_bus_[bus_id]) {
+            continue;
+        }
+        ForEachBusEdge(bus_id, 0, [this, &graph](const graph::Edge<double>& edge, const EdgeInfo& info) {
+            AddGraphEdge(graph, edge, info);
+        });
+    }
+}
+
+template <typename Weight>
+void TransportRouter::BuildRoutePatternGraph(graph::DirectedWeightedGraph<Weight>& graph) {
+    const size_t stop_count = stop_id_to_stop_.size();
+
+    ride_vertex_stops_.clear();
+    std::vector<size_t> ride_vertex_counts;
+    for (const auto* bus : bus_id_to_bus_) {
+        ride_vertex_counts.push_back(bus ? AppendRideVertexStops(*bus) : 0);
+    }
+    graph = graph::DirectedWeightedGraph<Weight>(stop_count + ride_vertex_stops_.size());
+
+    graph::VertexId ride_vertex = stop_count;
+    for (uint32_t bus_id = 0; bus_id < bus_id_to_bus_.size(); ++bus_id) {
+        if (!bus_id_to_bus_[bus_id]) {
+            continue;
+        }
+        ForEachBusEdge(bus_id, ride_vertex, [this, &graph](const graph::Edge<double>& edge, const EdgeInfo& info) {
+            AddGraphEdge(graph, edge, info);
         });
+        ride_vertex += ride_vertex_counts[bus_id];
     }
+}
 
-    for (const auto* bus : catalogue_.GetAllBuses()) {
-        if (!bus || bus->stops.empty()) continue;
-        const auto& stops = bus->stops;
-        const size_t n = stops.size();
-
-        for (size_t i = 0; i < n; ++i) {
-            auto from_it = stop_name_to_id_.find(stops[i]->name);
-            if (from_it == stop_name_to_id_.end()) continue;
-            size_t from_idx = from_it->second;
-
-            int accumulated_distance = 0;
-            for (size_t j = i + 1; j < n; ++j) {
-                accumulated_distance += catalogue_.GetDistance(stops[j-1], stops[j]);
-
-                auto to_it = stop_name_to_id_.find(stops[j]->name);
-                if (to_it == stop_name_to_id_.end()) continue;
-                size_t to_idx = to_it->second;
-
-                double weight = ComputeTravelTime(accumulated_distance);
-                graph::Edge<double> bus_edge{OutVertexId(from_idx), InVertexId(to_idx), weight};
-                graph_.AddEdge(bus_edge);
-                edge_info_.push_back({
-                    std::string(bus->name),
-                    j - i,
-                    std::string(stops[i]->name),
-                    std::string(stops[j]->name)
-                });
+void TransportRouter::IndexBusEdges() {
+    bus_edges_.assign(bus_id_to_bus_.size(), {});
+    std::visit([this](const auto& routing) {
+        for (graph::EdgeId edge_id = 0; edge_id < edge_info_.size(); ++edge_id) {
+            const uint32_t bus_id = edge_info_[edge_id].bus_id;
+            if (bus_id != NO_BUS && !routing.graph.IsEdgeRemoved(edge_id)) {
+                bus_edges_[bus_id].push_back(edge_id);
+            }
+        }
+    }, routing_);
+}
 
-                if (!bus->is_circle) {
-                    int rev_distance = 0;
-                    for (size_t k = j; k > i; --k) {
-                        rev_distance += catalogue_.GetDistance(stops[k], stops[k-1]);
-                    }
-                    double rev_weight = ComputeTravelTime(rev_distance);
-                    graph::Edge<double> rev_bus_edge{OutVertexId(to_idx), InVertexId(from_idx), rev_weight};
-                    graph_.AddEdge(rev_bus_edge);
-                    edge_info_.push_back({
-                        std::string(bus->name),
-                        j - i,
-                        std::string(stops[j]->name),
-                        std::string(stops[i]->name)
-                    });
+template <typename Weight>
+std::vector<graph::EdgeId> TransportRouter::RefreshBusEdgeWeights(graph::DirectedWeightedGraph<Weight>& graph,
+                                                                  uint32_t bus_id) {
+    std::vector<graph::EdgeId> changed_edges;
+    const auto& edge_ids = bus_edges_[bus_id];
+    if (edge_ids.empty()) {
+        return changed_edges;
+    }
+    // Рёбра автобуса порождаются в том же порядке, что и при построении; вершины не нужны
+    size_t index = 0;
+    ForEachBusEdge(bus_id, 0, [&](const graph::Edge<double>& edge, const EdgeInfo&) {
+        const graph::EdgeId edge_id = edge_ids.at(index++);
+        const Weight weight = ToWeight<Weight>(edge.weight);
+        if (graph.GetEdge(edge_id).weight != weight) {
+            graph.SetEdgeWeight(edge_id, weight);
+            changed_edges.push_back(edge_id);
+        }
+    });
+    return changed_edges;
+}
+
+std::vector<graph::EdgeId> TransportRouter::RemoveBusEdges(uint32_t bus_id) {
+    std::vector<graph::EdgeId> removed_edges = std::move(bus_edges_[bus_id]);
+    bus_edges_[bus_id].clear();
+    if (removed_edges.empty()) {
+        return removed_edges;
+    }
+    std::visit([&removed_edges](auto& routing) {
+        routing.graph.Unfreeze();
+        for (const graph::EdgeId edge_id : removed_edges) {
+            routing.graph.RemoveEdge(edge_id);
+        }
+        routing.graph.Freeze();
+    }, routing_);
+    return removed_edges;
+}
+
+std::optional<uint32_t> TransportRouter::FindGraphBus(std::string_view bus_name) const {
+    // Удалённый автобус справочник по имени уже не находит, поэтому ищем среди автобусов графа;
+    // это нужно только правкам состава автобусов
+    for (uint32_t bus_id = 0; bus_id < bus_id_to_bus_.size(); ++bus_id) {
+        if (bus_id_to_bus_[bus_id] && bus_id_to_bus_[bus_id]->name == bus_name) {
+            return bus_id;
+        }
+    }
+    return std::nullopt;
+}
+
+bool TransportRouter::HasGraphRouter() const {
+    return std::visit([](const auto& routing) {
+        return routing.router != nullptr;
+    }, routing_);
+}
+
+const RaptorRouter& TransportRouter::GetRaptor() const {
+    std::lock_guard guard(raptor_mutex_);
+    if (!raptor_) {
+        raptor_ = std::make_unique<RaptorRouter>(catalogue_, stop_id_to_stop_, stop_indices_,
+                                                 settings_.bus_wait_time, settings_.bus_velocity);
+    }
+    return *raptor_;
+}
+
+void TransportRouter::OnGraphChanged(const std::vector<graph::EdgeId>& changed_edges) {
+    {
+        std::lock_guard guard(raptor_mutex_);
+        raptor_.reset();
+    }
+    if (!HasGraphRouter()) {
+        return;
+    }
+    std::visit([&changed_edges](auto& routing) {
+        routing.router->UpdateEdges(changed_edges);
+    }, routing_);
+    if (settings_.router_mode == graph::RouterMode::A_STAR) {
+        SetupGeoPotential();
+    }
+}
+
+void TransportRouter::UpdateDistance(std::string_view from_stop, std::string_view to_stop) {
+    const auto* from = catalogue_.FindStop(from_stop);
+    const auto* to = catalogue_.FindStop(to_stop);
+    if (!from || !to) {
+        throw std::invalid_argument("Unknown stop");
+    }
+
+    // Расстояние в одну сторону служит и обратным, если то не задано явно,
+    // поэтому пересчитываем автобусы с перегоном в любом направлении
+    std::vector<graph::EdgeId> changed_edges;
+    if (HasGraphRouter()) {
+        for (const uint32_t bus_id : catalogue_.GetStopBuses(from->id)) {
+            // Автобус, ещё не переданный в AddBus, получит рёбра с новым расстоянием при добавлении
+            if (bus_id >= bus_id_to_bus_.size() || !bus_id_to_bus_[bus_id]) {
+                continue;
+            }
+            const auto& stops = bus_id_to_bus_[bus_id]->stops;
+            for (size_t i = 1; i < stops.size(); ++i) {
+                if ((stops[i - 1] == from && stops[i] == to) || (stops[i - 1] == to && stops[i] == from)) {
+                    const auto bus_changes = std::visit([this, bus_id](auto& routing) {
+                        return RefreshBusEdgeWeights(routing.graph, bus_id);
+                    }, routing_);
+                    changed_edges.insert(changed_edges.end(), bus_changes.begin(), bus_changes.end());
+                    break;
                 }
             }
         }
     }
+    OnGraphChanged(changed_edges);
 }
 
-std::vector<RoutingItem> TransportRouter::ReconstructRoute(const std::vector<graph::EdgeId>& edge_path) const
+void TransportRouter::AddBus(std::string_view bus_name) {
+    const auto* bus = catalogue_.FindBus(bus_name);
+    if (!bus) {
+        throw std::invalid_argument("Unknown bus");
+    }
+    const bool has_new_stops = std::any_of(bus->stops.begin(), bus->stops.end(), [this](const auto* stop) {
+        return GetStopIndex(*stop) == NO_STOP;
+    });
+    if (has_new_stops) {
+        // Новые остановки меняют нумерацию вершин: только полная пересборка
+        Build();
+        return;
+    }
+    if (!HasGraphRouter()) {
+        OnGraphChanged({});
+        return;
+    }
+
+    // Автобус с тем же именем заменяется целиком: в справочнике у замены свой номер
+    std::vector<graph::EdgeId> changed_edges;
+    if (const auto old_bus_id = FindGraphBus(bus->name)) {
+        changed_edges = RemoveBusEdges(*old_bus_id);
+        bus_id_to_bus_[*old_bus_id] = nullptr;
+    }
+    const uint32_t bus_id = bus->id;
+    if (bus_id >= bus_id_to_bus_.size()) {
+        bus_id_to_bus_.resize(bus_id + 1, nullptr);
+        bus_edges_.resize(bus_id + 1);
+    }
+    bus_id_to_bus_[bus_id] = bus;
+    auto& bus_edges = bus_edges_[bus_id];
+    std::visit([&](auto& routing) {
+        routing.graph.Unfreeze();
+        const graph::VertexId first_ride_vertex = routing.graph.GetVertexCount();
+        if (settings_.graph_model == GraphModel::ROUTE_PATTERN) {
+            for (size_t i = AppendRideVertexStops(*bus); i > 0; --i) {
+                routing.graph.AddVertex();
+            }
+        }
+        ForEachBusEdge(bus_id, first_ride_vertex, [&](const graph::Edge<double>& edge, const EdgeInfo& info) {
+            bus_edges.push_back(AddGraphEdge(routing.graph, edge, info));
+        });
+        routing.graph.Freeze();
+    }, routing_);
+    changed_edges.insert(changed_edges.end(), bus_edges.begin(), bus_edges.end());
+    OnGraphChanged(changed_edges);
+}
+
+void TransportRouter::RemoveBus(std::string_view bus_name) {
+    const auto bus_id = HasGraphRouter() ? FindGraphBus(bus_name) : std::nullopt;
+    if (!bus_id) {
+        OnGraphChanged({});
+        return;
+    }
+    bus_id_to_bus_[*bus_id] = nullptr;
+    OnGraphChanged(RemoveBusEdges(*bus_id));
+}
+
+template <typename Weight>
+std::vector<RoutingItem> TransportRouter::ReconstructRoute(const graph::DirectedWeightedGraph<Weight>& graph,
+                                                           const std::vector<graph::EdgeId>& edge_path) const
 {
     std::vector<RoutingItem> items;
+    // Подряд идущие перегоны без высадки — одна поездка (в STOP_PAIRS так не бывает).
+    // Её время считается по сумме расстояний перегонов, как для ребра STOP_PAIRS,
+    // а не складывается из времён отдельных перегонов
+    bool on_bus = false;
+    int ride_distance = 0;
+    auto segment_distance = [this](const EdgeInfo& einfo, const graph::Edge<Weight>& edge) {
+        return catalogue_.GetDistance(stop_id_to_stop_[einfo.stop_id], stop_id_to_stop_[GetVertexStop(edge.to)]);
+    };
 
     for (graph::EdgeId edge_id : edge_path) {
         const auto& einfo = edge_info_.at(edge_id);
-        const auto& edge = graph_.GetEdge(edge_id);
+        const auto edge = graph.GetEdge(edge_id);
 
-        if (einfo.bus_name.empty()) {
+        switch (einfo.type) {
+        case EdgeType::WAIT:
             items.push_back({
                 RoutingItem::Type::WAIT,
-                einfo.from_stop_name, "", 0, edge.weight
-            });
-        } else {
-            items.push_back({
-                RoutingItem::Type::BUS,
-                "", einfo.bus_name, einfo.span_count, edge.weight
+                std::string(stop_id_to_stop_[einfo.stop_id]->name), "", 0, ToMinutes(edge.weight)
             });
+            on_bus = false;
+            break;
+        case EdgeType::BUS:
+            if (on_bus) {
+                ride_distance += segment_distance(einfo, edge);
+                items.back().span_count += einfo.span_count;
+                items.back().time = ToMinutes(ToWeight<Weight>(ComputeTravelTime(ride_distance)));
+            } else {
+                items.push_back({
+                    RoutingItem::Type::BUS,
+                    "", std::string(bus_id_to_bus_[einfo.bus_id]->name), einfo.span_count,
+                    ToMinutes(edge.weight)
+                });
+                if (settings_.graph_model == GraphModel::ROUTE_PATTERN) {
+                    ride_distance = segment_distance(einfo, edge);
+                }
+            }
+            on_bus = true;
+            break;
+        case EdgeType::ALIGHT:
+            on_bus = false;
+            break;
         }
     }
     return items;
@@ -130,22 +733,226 @@ std::optional<RouteInfo> TransportRouter::BuildRoute(std::string_view from, std:
         return RouteInfo{0.0, {}};
     }
 
-    auto from_it = stop_name_to_id_.find(from);
-    auto to_it = stop_name_to_id_.find(to);
-    if (from_it == stop_name_to_id_.end() || to_it == stop_name_to_id_.end()) {
+    const auto from_stop = FindStopIndex(from);
+    const auto to_stop = FindStopIndex(to);
+    if (!from_stop || !to_stop) {
         return std::nullopt;
     }
 
-    graph::VertexId from_in = InVertexId(from_it->second);
-    graph::VertexId to_in = InVertexId(to_it->second);
+    if (settings_.routing_engine == RoutingEngine::RAPTOR) {
+        auto journey = GetRaptor().FindFastestJourney(*from_stop, *to_stop);
+        if (!journey) {
+            return std::nullopt;
+        }
+        return MakeRouteInfo(*journey);
+    }
 
-    auto route = router_->BuildRoute(from_in, to_in);
-    if (!route) {
-        return std::nullopt;
+    return std::visit([&](const auto& routing) -> std::optional<RouteInfo> {
+        auto route = routing.router->BuildRoute(GetStopVertex(*from_stop), GetStopVertex(*to_stop));
+        if (!route) {
+            return std::nullopt;
+        }
+        return MakeRouteInfo(routing.graph, *route);
+    }, routing_);
+}
+
+std::vector<std::optional<RouteInfo>> TransportRouter::BuildRoutes(
+    std::string_view from, const std::vector<std::string_view>& to) const
+{
+    std::vector<std::optional<RouteInfo>> routes(to.size());
+    if (settings_.routing_engine == RoutingEngine::RAPTOR) {
+        for (size_t i = 0; i < to.size(); ++i) {
+            routes[i] = BuildRoute(from, to[i]);
+        }
+        return routes;
+    }
+    const auto from_stop = FindStopIndex(from);
+
+    // Цели, которые нужно искать в графе, и их позиции в ответе
+    std::vector<graph::VertexId> targets;
+    std::vector<size_t> target_positions;
+    for (size_t i = 0; i < to.size(); ++i) {
+        if (to[i] == from) {
+            routes[i] = RouteInfo{0.0, {}};
+            continue;
+        }
+        const auto to_stop = FindStopIndex(to[i]);
+        if (!from_stop || !to_stop) {
+            continue;
+        }
+        targets.push_back(GetStopVertex(*to_stop));
+        target_positions.push_back(i);
     }
+    if (targets.empty()) {
+        return routes;
+    }
+
+    std::visit([&](const auto& routing) {
+        auto graph_routes = routing.router->BuildRoutes(GetStopVertex(*from_stop), targets);
+        for (size_t i = 0; i < graph_routes.size(); ++i) {
+            if (auto& route = graph_routes[i]) {
+                routes[target_positions[i]] = MakeRouteInfo(routing.graph, *route);
+            }
+        }
+    }, routing_);
+    return routes;
+}
 
-    auto items = ReconstructRoute(route->edges);
-    return RouteInfo{route->weight, std::move(items)};
+std::vector<RouteInfo> TransportRouter::BuildParetoRoutes(
+    std::string_view from, std::string_view to, size_t max_transfers) const
+{
+    if (from == to) {
+        return {RouteInfo{0.0, {}}};
+    }
+    const auto from_stop = FindStopIndex(from);
+    const auto to_stop = FindStopIndex(to);
+    if (!from_stop || !to_stop) {
+        return {};
+    }
+
+    std::vector<RouteInfo> routes;
+    for (const auto& journey : GetRaptor().FindJourneys(*from_stop, *to_stop, max_transfers)) {
+        routes.push_back(MakeRouteInfo(journey));
+    }
+    return routes;
+}
+
+std::optional<std::vector<ReachableStop>> TransportRouter::FindReachableStops(
+    std::string_view from, double max_time) const
+{
+    const auto from_stop = FindStopIndex(from);
+    if (!from_stop) {
+        const auto* stop = catalogue_.FindStop(from);
+        if (!stop) {
+            return std::nullopt;
+        }
+        // Через остановку без автобусов никуда не уехать, но сама она достижима
+        std::vector<ReachableStop> stops;
+        if (max_time >= 0.0) {
+            stops.push_back({std::string(stop->name), 0.0});
+        }
+        return stops;
+    }
+
+    std::vector<ReachableStop> stops;
+    if (settings_.routing_engine == RoutingEngine::RAPTOR) {
+        for (const auto& [stop, time] : GetRaptor().FindReachable(*from_stop, max_time)) {
+            stops.push_back({std::string(stop_id_to_stop_[stop]->name), time});
+        }
+    } else {
+        std::visit([&](const auto& routing) {
+            using Weight = typename std::decay_t<decltype(routing)>::Weight;
+            // Вершины «в автобусе» и вершины отправления остановкам не соответствуют
+            const Weight max_weight = ToWeight<Weight>(max_time);
+            for (const auto& [vertex, weight] : routing.router->FindReachable(GetStopVertex(*from_stop), max_weight)) {
+                const size_t stop = GetVertexStop(vertex);
+                if (GetStopVertex(stop) == vertex) {
+                    stops.push_back({std::string(stop_id_to_stop_[stop]->name), ToMinutes(weight)});
+                }
+            }
+        }, routing_);
+    }
+    // При равном времени порядок поиска не определён: упорядочиваем по имени
+    std::sort(stops.begin(), stops.end(), [](const ReachableStop& lhs, const ReachableStop& rhs) {
+        return lhs.time < rhs.time || (lhs.time == rhs.time && lhs.stop_name < rhs.stop_name);
+    });
+    return stops;
+}
+
+std::vector<std::optional<double>> TransportRouter::BuildTimeMatrix(
+    const std::vector<std::string_view>& from, const std::vector<std::string_view>& to) const
+{
+    std::vector<std::optional<double>> matrix(from.size() * to.size());
+    // Поиск ведётся только между известными маршрутизатору остановками; их позиции в матрице
+    auto collect_stops = [this](const std::vector<std::string_view>& names,
+                                std::vector<size_t>& stops, std::vector<size_t>& positions) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (const auto stop = FindStopIndex(names[i])) {
+                stops.push_back(*stop);
+                positions.push_back(i);
+            }
+        }
+    };
+    std::vector<size_t> from_stops, from_positions, to_stops, to_positions;
+    collect_stops(from, from_stops, from_positions);
+    collect_stops(to, to_stops, to_positions);
+
+    if (settings_.routing_engine == RoutingEngine::RAPTOR) {
+        // Один поиск по раундам из каждой остановки даёт время до всех остановок сразу
+        std::vector<double> arrivals(stop_id_to_stop_.size());
+        for (size_t i = 0; i < from_stops.size(); ++i) {
+            std::fill(arrivals.begin(), arrivals.end(), std::numeric_limits<double>::infinity());
+            const auto reachable = GetRaptor().FindReachable(from_stops[i], std::numeric_limits<double>::max());
+            for (const auto& [stop, time] : reachable) {
+                arrivals[stop] = time;
+            }
+            for (size_t j = 0; j < to_stops.size(); ++j) {
+                if (arrivals[to_stops[j]] != std::numeric_limits<double>::infinity()) {
+                    matrix[from_positions[i] * to.size() + to_positions[j]] = arrivals[to_stops[j]];
+                }
+            }
+        }
+    } else if (!from_stops.empty() && !to_stops.empty()) {
+        std::vector<graph::VertexId> sources, targets;
+        for (const size_t stop : from_stops) {
+            sources.push_back(GetStopVertex(stop));
+        }
+        for (const size_t stop : to_stops) {
+            targets.push_back(GetStopVertex(stop));
+        }
+        std::visit([&](const auto& routing) {
+            const auto weights = routing.router->BuildWeightMatrix(sources, targets);
+            for (size_t i = 0; i < sources.size(); ++i) {
+                for (size_t j = 0; j < targets.size(); ++j) {
+                    if (const auto& weight = weights[i * targets.size() + j]) {
+                        matrix[from_positions[i] * to.size() + to_positions[j]] = ToMinutes(*weight);
+                    }
+                }
+            }
+        }, routing_);
+    }
+
+    // Как и в BuildRoute, из остановки в неё же путь нулевой, даже если она неизвестна
+    for (size_t i = 0; i < from.size(); ++i) {
+        for (size_t j = 0; j < to.size(); ++j) {
+            if (from[i] == to[j]) {
+                matrix[i * to.size() + j] = 0.0;
+            }
+        }
+    }
+    return matrix;
+}
+
+template <typename Weight>
+RouteInfo TransportRouter::MakeRouteInfo(const graph::DirectedWeightedGraph<Weight>& graph,
+                                         const typename graph::Router<Weight>::RouteInfo& route) const {
+    RouteInfo info{ToMinutes(route.weight), ReconstructRoute(graph, route.edges), route.settled_vertices};
+    if (settings_.graph_model == GraphModel::ROUTE_PATTERN) {
+        // Вес пути сложен из времён отдельных перегонов; итог берём из пересчитанных элементов,
+        // чтобы он совпадал с суммой времён ответа, как в STOP_PAIRS
+        Weight total{};
+        for (const auto& item : info.items) {
+            total += ToWeight<Weight>(item.time);
+        }
+        info.total_time = ToMinutes(total);
+    }
+    return info;
+}
+
+RouteInfo TransportRouter::MakeRouteInfo(const RaptorRouter::Journey& journey) const {
+    RouteInfo route{journey.total_time, {}};
+    for (const auto& leg : journey.legs) {
+        route.items.push_back({
+            RoutingItem::Type::WAIT,
+            std::string(stop_id_to_stop_[leg.board_stop]->name), "", 0,
+            static_cast<double>(settings_.bus_wait_time)
+        });
+        route.items.push_back({
+            RoutingItem::Type::BUS,
+            "", std::string(leg.bus->name), leg.span_count, leg.time
+        });
+    }
+    return route;
 }
 
 } // namespace transport::routing
\ No newline at end of file
@@ -2,20 +2,47 @@
 
 #include "transport_catalogue.h"
 #include "graph.h"
+#include "raptor.h"
 #include "router.h"
+#include "serialization.h"
 
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <optional>
-#include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <variant>
 
 namespace transport::routing {
 
+enum class GraphModel {
+    STOP_PAIRS,     // ребро на каждую пару остановок одного автобуса, O(n²) рёбер на маршрут
+    ROUTE_PATTERN,  // вершина на каждую позицию маршрута, рёбра только между соседними остановками
+};
+
+enum class RoutingEngine {
+    GRAPH,   // поиск по графу рёбер выбранным router_mode
+    RAPTOR,  // поиск по раундам прямо по последовательностям остановок, граф не строится
+};
+
+enum class WeightType {
+    MINUTES,       // double: минуты как есть
+    CENTISECONDS,  // int64_t: сотые доли секунды, сравнения и суммы без ошибок округления
+};
+
 struct RoutingSettings {
     int bus_wait_time = 0;        // в минутах
     double bus_velocity = 0.0;    // км/ч
+    graph::RouterMode router_mode = graph::RouterMode::ALL_PAIRS;
+    GraphModel graph_model = GraphModel::STOP_PAIRS;  // JSONReader выбирает ROUTE_PATTERN для CH
+    RoutingEngine routing_engine = RoutingEngine::GRAPH;
+    WeightType weight_type = WeightType::MINUTES;  // веса графа; ответы всегда в минутах
+    size_t tree_cache_budget = 0; // в байтах, только для ON_DEMAND
+    size_t landmark_count = 8;    // ориентиры ALT среди остановок, только для A_STAR; 0 — без них
+    std::string cache_file;       // файл с готовым графом и таблицами; пусто — не используется
 };
 
 struct RoutingItem {
@@ -29,33 +56,141 @@ struct RoutingItem {
 struct RouteInfo {
     double total_time = 0.0;
     std::vector<RoutingItem> items;
+    size_t settled_vertices = 0;  // сколько вершин графа извлёк поиск
+};
+
+struct ReachableStop {
+    std::string stop_name;
+    double time = 0.0;            // в минутах
 };
 
 class TransportRouter {
 public:
     TransportRouter(const catalogue::TransportCatalogue& catalogue, const RoutingSettings& settings);
     std::optional<RouteInfo> BuildRoute(std::string_view from, std::string_view to) const;
+    // Маршруты из одной остановки во все перечисленные за один поиск
+    std::vector<std::optional<RouteInfo>> BuildRoutes(std::string_view from,
+                                                      const std::vector<std::string_view>& to) const;
+    // Парето-оптимальные по (времени, числу пересадок) маршруты не более чем с max_transfers
+    // пересадками, по возрастанию числа пересадок; пусто, если маршрута нет
+    std::vector<RouteInfo> BuildParetoRoutes(std::string_view from, std::string_view to,
+                                             size_t max_transfers) const;
+    // Остановки, куда можно доехать из from не дольше чем за max_time минут, по возрастанию
+    // времени; nullopt, если остановки from нет
+    std::optional<std::vector<ReachableStop>> FindReachableStops(std::string_view from, double max_time) const;
+    // Время в пути из каждой остановки from в каждую остановку to, построчно, без восстановления
+    // маршрутов; nullopt, если маршрута нет или остановка неизвестна
+    std::vector<std::optional<double>> BuildTimeMatrix(const std::vector<std::string_view>& from,
+                                                       const std::vector<std::string_view>& to) const;
     double ComputeTravelTime(int distance_meters) const;
+    graph::TreeCacheStats GetTreeCacheStats() const;
+
+    // Инкрементальные обновления; вызываются после соответствующей правки каталога.
+    // Пересчитываются только рёбра затронутых автобусов, а маршрутизатор чинит лишь
+    // зависящие от них строки таблиц и деревья. Автобус с остановками, которых ещё нет
+    // в графе, меняет нумерацию вершин и вызывает полную пересборку. RAPTOR пересобирается
+    // при следующем обращении к нему.
+    void UpdateDistance(std::string_view from_stop, std::string_view to_stop);
+    void AddBus(std::string_view bus_name);
+    void RemoveBus(std::string_view bus_name);
     
 private:
+    enum class EdgeType : uint32_t {
+        WAIT,    // ожидание автобуса на остановке (в ROUTE_PATTERN — посадка)
+        BUS,     // поездка на span_count перегонов
+        ALIGHT,  // высадка, только в ROUTE_PATTERN
+    };
+
+    // Метаданные ребра без строк: имена берутся по номерам только при восстановлении маршрута
     struct EdgeInfo {
-        std::string bus_name;
-        size_t span_count;
-        std::string from_stop_name;
-        std::string to_stop_name;
+        EdgeType type;
+        uint32_t bus_id;      // номер автобуса в справочнике или NO_BUS для ожидания в STOP_PAIRS
+        uint32_t stop_id;     // остановка ожидания, отправления или высадки
+        uint32_t span_count;  // для BUS
     };
+    static constexpr uint32_t NO_BUS = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t NO_STOP = std::numeric_limits<uint32_t>::max();
 
     const catalogue::TransportCatalogue& catalogue_;
     RoutingSettings settings_;
     std::vector<const domain::Stop*> stop_id_to_stop_;
-    std::unordered_map<std::string_view, graph::VertexId> stop_name_to_id_;
+    // Номер в справочнике каждой остановки stop_id_to_stop_: по нему читаются столбцы координат
+    std::vector<uint32_t> stop_catalogue_ids_;
+    // Номер остановки в stop_id_to_stop_ по её номеру в справочнике, NO_STOP — у остановок без автобусов
+    std::vector<uint32_t> stop_indices_;
+    // Автобусы графа по номеру в справочнике; nullptr — удалённые, перекрытые одноимёнными
+    // и ещё не переданные в AddBus
+    std::vector<const domain::Bus*> bus_id_to_bus_;
 
-    graph::DirectedWeightedGraph<double> graph_;
-    std::unique_ptr<graph::Router<double>> router_;
+    // Граф и маршрутизатор в весах settings_.weight_type
+    template <typename WeightT>
+    struct GraphRouting {
+        using Weight = WeightT;
+        graph::DirectedWeightedGraph<Weight> graph;
+        std::unique_ptr<graph::Router<Weight>> router;
+    };
+    std::variant<GraphRouting<double>, GraphRouting<int64_t>> routing_;
+    // Строится при первом запросе к RAPTOR и сбрасывается при каждой правке: в движке GRAPH
+    // он нужен только запросам с max_transfers, и правки не должны платить за его пересборку
+    mutable std::mutex raptor_mutex_;
+    mutable std::unique_ptr<RaptorRouter> raptor_;
     std::vector<EdgeInfo> edge_info_;
+    // Остановка каждой вершины «в автобусе» модели ROUTE_PATTERN; они нумеруются после остановок
+    std::vector<uint32_t> ride_vertex_stops_;
+    // Рёбра каждого автобуса (по номеру) в порядке их порождения ForEachBusEdge
+    std::vector<std::vector<graph::EdgeId>> bus_edges_;
+    // Минуты на метр расстояния по сфере, не превосходящие реальное время в пути
+    double min_time_per_geo_meter_ = 0.0;
 
-    void BuildGraph();
-    std::vector<RoutingItem> ReconstructRoute(const std::vector<graph::EdgeId>& edge_path) const;
+    void Build();
+    template <typename Weight>
+    void BuildGraph(graph::DirectedWeightedGraph<Weight>& graph);
+    template <typename Weight>
+    void BuildStopPairGraph(graph::DirectedWeightedGraph<Weight>& graph);
+    template <typename Weight>
+    void BuildRoutePatternGraph(graph::DirectedWeightedGraph<Weight>& graph);
+    // Добавляет ребро с весом в минутах, переведённым в единицы графа
+    template <typename Weight>
+    graph::EdgeId AddGraphEdge(graph::DirectedWeightedGraph<Weight>& graph, const graph::Edge<double>& edge,
+                               const EdgeInfo& info);
+    // Порождает рёбра автобуса с весами в минутах: callback(edge, info). В модели ROUTE_PATTERN
+    // его вершины «в автобусе» нумеруются подряд с first_ride_vertex.
+    template <typename Callback>
+    void ForEachBusEdge(uint32_t bus_id, graph::VertexId first_ride_vertex, Callback&& callback) const;
+    // Дописывает остановки вершин «в автобусе» автобуса и возвращает их число
+    size_t AppendRideVertexStops(const domain::Bus& bus);
+    void IndexBusEdges();
+    template <typename Weight>
+    std::vector<graph::EdgeId> RefreshBusEdgeWeights(graph::DirectedWeightedGraph<Weight>& graph, uint32_t bus_id);
+    std::vector<graph::EdgeId> RemoveBusEdges(uint32_t bus_id);
+    // Номер автобуса графа с этим именем; справочник его уже может не знать
+    std::optional<uint32_t> FindGraphBus(std::string_view bus_name) const;
+    bool HasGraphRouter() const;
+    const RaptorRouter& GetRaptor() const;
+    void OnGraphChanged(const std::vector<graph::EdgeId>& changed_edges);
+    uint32_t GetStopIndex(const domain::Stop& stop) const;
+    std::optional<size_t> FindStopIndex(std::string_view stop_name) const;
+    // Вершина, из которой ищутся и в которую приходят маршруты остановки
+    graph::VertexId GetStopVertex(size_t stop_index) const;
+    std::vector<graph::VertexId> GetStopVertices() const;
+    size_t GetVertexStop(graph::VertexId vertex) const;
+    // Уехать из вершины к другой остановке можно только после ожидания автобуса
+    bool IsBoardingVertex(graph::VertexId vertex) const;
+    // Контрольная сумма всего, от чего зависят граф и таблицы маршрутизатора
+    uint64_t ComputeInputChecksum() const;
+    bool LoadFromFile(const std::string& path);
+    bool SaveToFile(const std::string& path) const;
+    // Нижняя оценка времени в пути по расстоянию на сфере (для режима A*)
+    void SetupGeoPotential();
+    double ComputeGeoDistance(size_t from_stop, size_t to_stop) const;
+    double ComputeLowerBoundTime(size_t from_stop, size_t to_stop) const;
+    template <typename Weight>
+    std::vector<RoutingItem> ReconstructRoute(const graph::DirectedWeightedGraph<Weight>& graph,
+                                              const std::vector<graph::EdgeId>& edge_path) const;
+    template <typename Weight>
+    RouteInfo MakeRouteInfo(const graph::DirectedWeightedGraph<Weight>& graph,
+                            const typename graph::Router<Weight>::RouteInfo& route) const;
+    RouteInfo MakeRouteInfo(const RaptorRouter::Journey& journey) const;
 };
 
 } // namespace transport::routing
\ No newline at end of file